@@ -0,0 +1,66 @@
+#ifndef Animation_h
+#define Animation_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/* De waarden die een animatie kan sturen */
+enum animationChannel {
+    ANIM_INTENSITY, // helderheid van de matrices (0..15)
+    ANIM_WIPE,      // aantal rijen dat al het nieuwe beeld toont (0..8)
+    ANIM_CHANNELS
+};
+
+/* Een sleutelbeeld: de waarde op time miliseconden na het begin van het spoor */
+struct keyframe {
+    unsigned int time;
+    byte value;
+};
+
+/*
+ * Speelt sporen van sleutelbeelden uit PROGMEM af, een spoor per kanaal.
+ * Tussen twee sleutelbeelden wordt lineair geinterpoleerd, met gehele getallen.
+ * update() wordt eenmaal per frame aangeroepen en meldt welke kanalen een
+ * andere waarde hebben gekregen; alleen die hoeven naar de matrices.
+ */
+class Animation {
+    const keyframe *frames[ANIM_CHANNELS];
+    byte count[ANIM_CHANNELS];
+    bool repeat[ANIM_CHANNELS];
+    unsigned long start[ANIM_CHANNELS];
+    byte value[ANIM_CHANNELS];
+
+    byte sample(byte channel, unsigned long t);
+
+  public:
+    Animation();
+
+    /*
+     * Begin een spoor op een kanaal.
+     * Params :
+     * channel	animationChannel
+     * frames	sleutelbeelden in PROGMEM, oplopend in tijd, het eerste op tijd 0
+     * count	aantal sleutelbeelden
+     * repeat	true om het spoor te herhalen
+     */
+    void play(byte channel, const keyframe *frames, byte count, bool repeat);
+
+    void stop(byte channel);
+
+    bool playing(byte channel);
+
+    /*
+     * Bereken alle kanalen voor nu.
+     * Returns :
+     * byte	een bit per kanaal (1 << channel) dat een nieuwe waarde heeft
+     */
+    byte update();
+
+    /* De laatst berekende waarde van een kanaal */
+    byte get(byte channel);
+};
+
+#endif //Animation.h
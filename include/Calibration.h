@@ -0,0 +1,71 @@
+#ifndef Calibration_h
+#define Calibration_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+#include "Persist.h"
+
+// Aantal metingen per stand
+#ifndef CAL_SAMPLES
+#define CAL_SAMPLES 32
+#endif
+
+// Grootste spreiding (max - min) binnen een stand. Meer betekent dat de
+// zandloper niet stil lag, en dan wordt de stand opnieuw gemeten.
+#ifndef CAL_MAX_NOISE
+#define CAL_MAX_NOISE 12
+#endif
+
+// Kleinste geldige uitslag bij 1g. Een kleinere of negatieve uitslag betekent
+// dat de standen in de verkeerde volgorde zijn gemeten.
+#ifndef CAL_MIN_SCALE
+#define CAL_MIN_SCALE 30
+#endif
+
+// Dode zone in 1/64 van de uitslag bij 1g. 30/64 komt overeen met de oude
+// vaste drempels (33 op 70).
+#ifndef CAL_BAND
+#define CAL_BAND 30
+#endif
+
+/*
+ * Kalibreert de accelerometer uit vier rustende standen: 0, 90, 180 en 270 graden.
+ * In stand 0 en 180 ligt de X-as langs de zwaartekracht, in 90 en 270 de Y-as.
+ * Het nulpunt van een as is het midden tussen zijn twee standen, de uitslag bij
+ * 1g de halve afstand. Alles met gehele getallen.
+ */
+class Calibrator {
+    int mean[4][2];
+    byte measured;
+    int lastSpread;
+
+  public:
+    Calibrator();
+
+    /*
+     * Meet een stand.
+     * Params :
+     * orientation	stand als gravity / 90 (0..3)
+     * Returns :
+     * bool	false als de zandloper niet stil lag
+     */
+    bool sample(byte orientation, byte pinX, byte pinY);
+
+    /* De grootste spreiding van de laatste meting, in ADC-eenheden */
+    int spread();
+
+    /* Zijn alle vier de standen gemeten */
+    bool complete();
+
+    /*
+     * Bereken nulpunt, uitslag en dode zone per as.
+     * Returns :
+     * bool	false als de metingen geen geldige kalibratie geven; cal blijft dan ongewijzigd
+     */
+    bool compute(calibration &cal);
+};
+
+#endif //Calibration.h
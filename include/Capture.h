@@ -0,0 +1,191 @@
+#ifndef Capture_h
+#define Capture_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "Persist.h"
+#include "Protocol.h"
+
+/*
+ * Neemt de invoer van de zandloper op, zodat een storing bij een klant op de
+ * host kan worden nagespeeld met tools/replay (zie daar). Opgenomen worden de
+ * ruwe metingen van de accelerometer, de flanken van de knop, ontvangen
+ * commando's en af en toe een momentopname van de toestand met het zaad van
+ * de random generator.
+ *
+ * Alleen actief met -D CAPTURE=1 (over de seriele poort, als FRAME_CAPTURE)
+ * of -D CAPTURE=2 (in een ring in SRAM, die na het setupmenu en met
+ * CMD_CAPTURE in EEPROM wordt bewaard). Zonder CAPTURE kost het niets.
+ *
+ * De opname bestaat uit blokken van hooguit PROTOCOL_MAX_PAYLOAD bytes:
+ *   volgnummer (1), millis() bij het begin (4), records
+ * Elk blok staat op zichzelf, zodat een verloren frame of een overschreven
+ * blok in de ring alleen zijn eigen records kost. Een record begint met
+ * type << 5 | dt, met dt de miliseconden sinds het vorige record in het blok;
+ * dt = 31 betekent dat er een uint16 met dt volgt. Getallen zijn little-endian.
+ */
+
+#define CAPTURE_OFF 0
+#define CAPTURE_SERIAL 1
+#define CAPTURE_RING 2
+#ifndef CAPTURE
+#define CAPTURE CAPTURE_OFF
+#endif
+
+// Grootte van de ring in SRAM, past met de lengte in het EEPROM vanaf CAPTURE_EEPROM_BASE
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE 256
+#endif
+// Achter de ring van Persist (16 plaatsen van 40 bytes), voor het programma van Sequencer
+#define CAPTURE_EEPROM_BASE 640
+#define CAPTURE_EEPROM_SIZE 360
+
+// Een blok gaat uiterlijk zoveel miliseconden na het begin over de seriele poort
+#ifndef CAPTURE_FLUSH
+#define CAPTURE_FLUSH 250
+#endif
+
+// Tijd tussen twee momentopnamen; naspelen kan alleen vanaf een momentopname
+#ifndef CAPTURE_SNAPSHOT
+#define CAPTURE_SNAPSHOT 5000UL
+#endif
+// In de ring ook na zoveel bytes, zodat er altijd een volledige overblijft om vanaf te beginnen
+#define CAPTURE_SNAPSHOT_BYTES (CAPTURE_RING_SIZE / 2)
+
+#define CAPTURE_HEADER 5
+#define CAPTURE_DT_ESCAPE 31
+
+// Houd deze lijsten gelijk met tools/replay/replay.cpp en tools/zandloper.py
+enum captureRecord {
+    CAP_SAMPLE,      // meting van de ADC-interrupt: X en Y, 10 bits elk in 3 bytes
+    CAP_DELTA,       // meting als verschil met de vorige: dx << 4 | dy, elk -8..7
+    CAP_SAME,        // meting gelijk aan de vorige
+    CAP_READ,        // analogRead() van X en Y buiten loop(), 3 bytes als CAP_SAMPLE
+    CAP_BUTTON_DOWN, // de knop is ingedrukt
+    CAP_BUTTON_UP,   // de knop is losgelaten
+    CAP_INFO,        // soort (captureInfo) en gegevens
+    CAP_COMMAND      // ontvangen commando: type, lengte, payload; zie CAPTURE_MORE
+};
+
+// In de lengte van CAP_COMMAND: het commando gaat verder in het volgende record, omdat
+// een lange payload niet in een blok past
+#define CAPTURE_MORE 0x80
+
+enum captureInfo {
+    CAP_INFO_STATE, // mode, korrels door de hals, vlaggen, miliseconden tot de volgende korrel (uint16), segment, korrel
+    CAP_INFO_CAL,   // calibration
+    CAP_INFO_BOARD, // 16 rijen, A en dan B
+    CAP_INFO_SEED,  // captureMoment: zaad, reden (byte), ms sinds vaste, activiteit, frame, richting; sluit af
+    CAP_INFO_LOST   // aantal records dat niet kon worden opgenomen (uint16)
+};
+
+// Waarom een momentopname is genomen
+enum captureReason {
+    CAP_REASON_BOOT,  // aan het einde van setup()
+    CAP_REASON_FIXED, // na de kalibratie en elke CAPTURE_SNAPSHOT
+    CAP_REASON_RING   // de ring was voor de helft gevuld sinds de vorige
+};
+
+/* Wat een momentopname naast het persistRecord vastlegt, zodat tools/replay er op tijd verder kan */
+struct captureMoment {
+    unsigned int seed;    // nieuw zaad van de random generators
+    byte reason;          // captureReason
+    unsigned long time;   // millis() van het frame
+    unsigned long fixed;  // millis() van de laatste vaste momentopname
+    unsigned long active; // millis() van de laatste activiteit (FrameRate)
+    unsigned long frame;  // millis() bij het begin van het frame
+    int gravity;          // lastGravity, de richting van het vorige frame
+};
+
+// Acties van CMD_CAPTURE
+#define CAPTURE_DUMP 0       // stuur de ring als FRAME_CAPTURE
+#define CAPTURE_SAVE 1       // bewaar de ring in EEPROM
+#define CAPTURE_DUMP_SAVED 2 // stuur de bewaarde ring als FRAME_CAPTURE
+
+class Capture {
+    byte chunk[PROTOCOL_MAX_PAYLOAD];
+    byte used;
+    byte sequence;
+    unsigned long chunkStart;
+    unsigned long lastTime;
+    int lastX;
+    int lastY;
+    bool haveSample;
+    unsigned int lost;
+
+#if CAPTURE == CAPTURE_RING
+    // Blokken met hun lengte ervoor; het oudste blok maakt plaats voor een nieuw
+    byte ring[CAPTURE_RING_SIZE];
+    unsigned int tail;
+    unsigned int filled;
+    // Tijdens het bewaren staat de ring stil, nieuwe records gaan verloren
+    bool saving;
+    unsigned int saved;
+    unsigned int sinceSnapshot;
+
+    void store();
+#else
+    // Een momentopname die tools/replay vraagt, zoals de ring in de opname er een nam
+    bool requested;
+    unsigned long requestAt;
+#endif
+
+    bool reserve(unsigned long time, byte length);
+    void tag(byte type, unsigned long time);
+    void put(byte b);
+    void put16(unsigned int value);
+    void putSample(int x, int y);
+    void info(byte kind, const byte *data, byte length, unsigned long time);
+    void close();
+
+  public:
+    Capture();
+
+    /*
+     * Een meting van de accelerometer.
+     * Params :
+     * x, y		ruwe ADC-waarden
+     * time		millis() van de meting
+     * read		true voor analogRead() buiten loop(), false voor de ADC-interrupt
+     */
+    void sample(int x, int y, unsigned long time, bool read);
+
+    /* Een flank van de knop */
+    void button(bool down, unsigned long time);
+
+    /* Een ontvangen commando */
+    void command(const protocolFrame &frame);
+
+    /* Een momentopname van de toestand en het zaad waarmee de random generator opnieuw begint */
+    void snapshot(const persistRecord &r, const captureMoment &m);
+
+    /*
+     * Params :
+     * now		millis() van het frame
+     * Returns : true als de ring een nieuwe momentopname nodig heeft, los van CAPTURE_SNAPSHOT
+     */
+    bool snapshotDue(unsigned long now);
+
+    /*
+     * Voor tools/replay: laat snapshotDue() in het eerste frame vanaf time true geven,
+     * zodat de nagespeelde firmware een momentopname neemt waar de ring dat deed.
+     * Returns : false als het vorige verzoek nog openstaat
+     */
+    bool request(unsigned long time);
+
+    /* Eenmaal per frame: stuur een oud blok weg en schrijf verder aan een bewaring in EEPROM */
+    void service();
+
+    /* Voer een CMD_CAPTURE uit */
+    void action(byte what);
+};
+
+#if CAPTURE
+extern Capture capture;
+#endif
+
+#endif //Capture.h
@@ -6,7 +6,14 @@
 #define CIJFER_0ACCENT 10
 #define ACCENT 11
 #define BLANK 12
-byte cijfers[13][8] = {
+#define LETTER_P 13 // programma's in het menu: P1, P2, ...
+#define LETTER_U 14 // uren: 2u, 3u, ...
+// Merktekens bij een cijfer, in de rechterkolom: de kolom ertussen blijft leeg
+#define MARK_MINUTES 0x40 // een streepje rechtsboven, als een "
+#define MARK_HOURS 0x80   // een punt rechtsonder
+#define GLYPH_MASK 0x3F
+// De cijfers staan in PROGMEM: lees ze met pgm_read_byte() of memcpy_P().
+const static byte cijfers[15][8] PROGMEM = {
     {// 0
      B00111000,
      B01000100,
@@ -124,4 +131,22 @@ byte cijfers[13][8] = {
      B00000000,
      B00000000,
      B00000000},
+    {// P
+     B01111000,
+     B01000100,
+     B01000100,
+     B01111000,
+     B01000000,
+     B01000000,
+     B01000000,
+     B01000000},
+    {// u
+     B00000000,
+     B00000000,
+     B01000100,
+     B01000100,
+     B01000100,
+     B01000100,
+     B01001100,
+     B00110100},
 };
@@ -0,0 +1,60 @@
+#ifndef Compositor_h
+#define Compositor_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+#include "LedControl.h"
+
+// Aantal matrices in de ketting
+#define COMPOSITOR_DEVICES 2
+
+/* Hoe de overlay met het zand wordt gecombineerd, per rij met bytebewerkingen */
+enum blendMode {
+    BLEND_OR,      // zand | overlay: de overlay brandt altijd
+    BLEND_XOR,     // zand ^ overlay: de overlay blijft leesbaar op vol zand
+    BLEND_MASK,    // zand & ~overlay: de overlay wordt uit het zand gesneden
+    BLEND_REPLACE, // alleen de overlay, het zand loopt onzichtbaar door
+};
+
+/*
+ * Legt een overlay over het zand zonder de simulatie aan te raken. Het zand
+ * blijft in LedControl staan; zolang de overlay zichtbaar is, houdt
+ * LedControl zijn wijzigingen vast (hold) en stuurt flush() per rij de
+ * combinatie van beide lagen. Alleen rijen die anders zijn dan wat er al
+ * op de matrices staat gaan over de bus, een transactie per rij voor alle
+ * matrices samen.
+ */
+class Compositor {
+    byte overlay[COMPOSITOR_DEVICES][8];
+    byte shown[COMPOSITOR_DEVICES][8];
+    byte blend;
+    bool active;
+    bool forced;
+
+    byte compose(byte sand, byte over);
+
+  public:
+    Compositor();
+
+    /* Maak de overlay van een matrix leeg */
+    void clear(byte addr);
+
+    /* Zet een rij van de overlay, bijvoorbeeld voor voortgangsstreepjes */
+    void setRow(byte addr, byte row, byte value);
+
+    /* Maak de overlay zichtbaar met de gegeven menging */
+    void show(LedControl &lc, blendMode mode);
+
+    /* Haal de overlay weg: alleen het zand blijft over en LedControl stuurt weer zelf */
+    void hide(LedControl &lc);
+
+    bool visible();
+
+    /* Stuur de rijen waarvan de combinatie veranderd is */
+    void flush(LedControl &lc);
+};
+
+#endif //Compositor.h
@@ -0,0 +1,65 @@
+#ifndef FrameRate_h
+#define FrameRate_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+// Frametijd terwijl het zand beweegt of net na het omdraaien (40 Hz)
+#ifndef FRAME_FAST
+#define FRAME_FAST 25
+#endif
+
+// Langste frametijd als alles stil ligt. Korter dan een korte druk op de knop,
+// zodat loop() die nog steeds ziet.
+#ifndef FRAME_IDLE
+#define FRAME_IDLE 150
+#endif
+
+// Zo lang na de laatste beweging blijven we op FRAME_FAST
+#ifndef FRAME_ACTIVE_HOLD
+#define FRAME_ACTIVE_HOLD 500
+#endif
+
+/*
+ * Bepaalt hoe lang loop() wacht tot het volgende frame. Zolang er zand beweegt
+ * draait de simulatie snel; ligt alles stil, dan wordt alleen nog gewacht tot
+ * de volgende korrel door de hals moet, met FRAME_IDLE als maximum.
+ */
+class FrameRate {
+    unsigned long lastFrame;
+    unsigned long lastActive;
+
+  public:
+    FrameRate();
+
+    /* Er is iets bewogen of de zandloper is gedraaid */
+    void activity();
+
+    /*
+     * Het aantal miliseconden tot het volgende frame.
+     * Params :
+     * deadline	millis() waarop de volgende korrel door de hals moet
+     */
+    unsigned long remaining(unsigned long deadline);
+
+    /* Het volgende frame begint nu */
+    void frame();
+
+    /* Miliseconden sinds de laatste activiteit */
+    unsigned long idleTime();
+
+    /* De frametijd die nu geldt, in miliseconden */
+    unsigned long period();
+
+    /* millis() bij het begin van het frame en bij de laatste activiteit, voor een momentopname */
+    unsigned long frameStart();
+    unsigned long lastActivity();
+
+    /* Voor tools/replay: ga verder met het frame en de activiteit uit een momentopname */
+    void resume(unsigned long frame, unsigned long active);
+};
+
+#endif //FrameRate.h
@@ -0,0 +1,83 @@
+#ifndef Input_h
+#define Input_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "Queue.h"
+
+// Aantal gebeurtenissen dat tussen twee frames kan wachten (macht van twee)
+#ifndef INPUT_QUEUE_SIZE
+#define INPUT_QUEUE_SIZE 16
+#endif
+
+/* Soorten gebeurtenissen */
+enum inputEventType {
+    EVENT_BUTTON, // value: niveau van de knop na de flank (LOW = ingedrukt)
+    EVENT_ADC_X,  // value: ADC-waarde van de X-as
+    EVENT_ADC_Y   // value: ADC-waarde van de Y-as
+};
+
+/* Een gebeurtenis uit een interrupt, met de tijd in miliseconden (de onderste 16 bits van millis()) */
+struct inputEvent {
+    byte type;
+    int value;
+    unsigned int time;
+};
+
+/*
+ * Knop en accelerometer via interrupts in plaats van digitalRead() en
+ * analogRead() in het frame. De knop geeft op elke flank een gebeurtenis;
+ * sample() start een meting van beide assen die de ADC-interrupt afmaakt.
+ * loop() haalt alle gebeurtenissen eenmaal per frame op met next().
+ *
+ * analogRead() blijft bruikbaar: de ADC-interrupt staat alleen aan tijdens een
+ * meting van sample(), en finish() wacht tot die klaar is.
+ */
+class Input {
+    Queue<inputEvent, INPUT_QUEUE_SIZE> events;
+    byte buttonPin;
+    byte channelX;
+    byte channelY;
+
+  public:
+    /*
+     * Params :
+     * buttonPin	pin van de knop, moet een externe interrupt zijn
+     * pinX, pinY	analoge pinnen van de accelerometer
+     */
+    void begin(byte buttonPin, byte pinX, byte pinY);
+
+    /* Koppel de knopinterrupt (opnieuw), ook na PowerManager::powerDown() */
+    void attach();
+
+    /* Start een meting van X en daarna Y op de achtergrond */
+    void sample();
+
+    /* Wacht tot een meting van sample() klaar is, voor een analogRead() */
+    void finish();
+
+    /*
+     * Haal de oudste gebeurtenis op.
+     * Returns :
+     * bool	false als er niets meer is
+     */
+    bool next(inputEvent &event);
+
+    /* Gooi alle wachtende gebeurtenissen weg */
+    void clear();
+
+    /* Aantal gebeurtenissen dat niet meer in de buffer paste */
+    byte dropped();
+
+    /* Alleen voor de interrupts */
+    void buttonChanged();
+    void conversionDone();
+};
+
+extern Input input;
+
+#endif //Input.h
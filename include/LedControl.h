@@ -69,6 +69,10 @@ class LedControl {
         byte spidata[16];
         /* Send out a single command to the device */
         void spiTransfer(int addr, byte opcode, byte data);
+        /* Send the same opcode to every device in one transaction, one data byte per device */
+        void spiTransferChain(byte opcode, const byte *data);
+        /* Send the same opcode and data to every device in one transaction */
+        void spiTransferAll(byte opcode, byte data);
 
         /* We keep track of the led-status for all 8 devices in this array */
         byte status[64];
@@ -83,6 +87,8 @@ class LedControl {
         int maxDevices;
 
         int rotation;
+        /* While true the led-status is only stored, not sent to the devices */
+        bool held;
 
     public:
         /*
@@ -95,6 +101,16 @@ class LedControl {
          */
         LedControl(int dataPin, int clkPin, int csPin, int numDevices=1);
 
+        /*
+         * Set up the pins and initialize all devices. The constructor does not
+         * touch the hardware, so this must be called from setup(). Every register
+         * is written to the whole chain at once: 13 transactions in total, after
+         * which the devices are cleared and switched on.
+         * Params :
+         * intensity	the brightness of all devices (0..15)
+         */
+        void begin(int intensity);
+
         void setRotation(int rot);
 
         /*
@@ -131,6 +147,13 @@ class LedControl {
          */
         void setIntensity(int addr, int intensity);
 
+        /*
+         * Set the brightness of all devices in one transaction.
+         * Params:
+         * intensity	the brightness of the displays. (0..15)
+         */
+        void setIntensityAll(int intensity);
+
         /*
          * Switch all Leds on the display off.
          * Params:
@@ -167,6 +190,26 @@ class LedControl {
         coord rotate180(coord xy);
         coord rotate270(coord xy);
 
+        /*
+         * Stop or resume sending led changes to the devices. While held, all
+         * set-functions only update the stored state, so something else (a
+         * compositor) can decide what is shown with showRow().
+         */
+        void hold(bool h);
+
+        /*
+         * Show a row on all devices in one transaction, without changing the
+         * stored state. Also works while held.
+         * Params :
+         * row		the row to show (0..7)
+         * values	one byte per device, device 0 first
+         */
+        void showRow(int row, const byte *values);
+
+        /*
+         * Save the state of all devices, and write it back later with the
+         * same 8 chained transactions as setAll().
+         */
         void backup();
         void restore();
 
@@ -180,6 +223,24 @@ class LedControl {
          */
         void setRow(int addr, int row, byte value);
 
+        /*
+         * Get the state of all 8 Led's in a row
+         * Params:
+         * addr	address of the display
+         * row	row which is to be read (0..7)
+         * Returns :
+         * byte	each bit set to 1 is a Led that is switched on
+         */
+        byte getRow(int addr, int row);
+
+        /*
+         * Replace the state of all devices at once. Every row is sent to the
+         * whole chain in a single transaction, so 8 transactions in total.
+         * Params:
+         * rows	8 bytes per device, device 0 first
+         */
+        void setAll(const byte *rows);
+
         /*
          * Set all 8 Led's in a column to a new state
          * Params:
@@ -0,0 +1,108 @@
+#ifndef Log_h
+#define Log_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Binaire logging zonder teksten in de firmware. Een bericht is een id met
+ * hooguit twee getallen; de teksten staan alleen in tools/zandloper.py.
+ * Berichten gaan eerst in een ringbuffer en worden per frame als FRAME_LOG
+ * naar het protocol doorgezet, zonder ooit op de poort te wachten.
+ *
+ * De payload is: id, tijd (millis, 16 bits), argumenten (elk 16 bits).
+ * Alle getallen zijn little-endian.
+ */
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Grootte van de ringbuffer, een macht van 2
+#ifndef LOG_BUFFER
+#define LOG_BUFFER 64
+#endif
+
+// Langste record: id, tijd en twee argumenten
+#define LOG_RECORD_MAX 7
+
+// Houd deze lijst gelijk met MESSAGES in tools/zandloper.py
+enum logMessage {
+    LOG_BOOT,            // geen argumenten
+    LOG_STARTUP_SOUND,   // geen argumenten
+    LOG_MODE,            // seconden van het (eerste) segment, miliseconden tot de eerste korrel
+    LOG_ALARM,           // geen argumenten
+    LOG_SETUP,           // geen argumenten
+    LOG_STANDBY,         // percentage wakker
+    LOG_AXES,            // xCalc, yCalc
+    LOG_PARTICLE_TIME,   // microseconden laatste stap, piek
+    LOG_DROPPED,         // aantal weggegooide bytes
+    LOG_MEMORY_LOW,      // kleinste vrije ruimte tussen stack en heap
+    LOG_RESUME,          // seconden van het segment, korrels al door de hals
+    LOG_CALIBRATE,       // geen argumenten
+    LOG_CALIBRATION_UNSTABLE, // stand in graden, spreiding
+    LOG_CALIBRATION_FAILED, // geen argumenten
+    LOG_CALIBRATED,      // nulpunt X, nulpunt Y
+    LOG_FIRST_FRAME,     // miliseconden, microseconden sinds de reset tot het eerste frame
+    LOG_CAPTURE_SAVED,   // bytes in EEPROM, records verloren tijdens het bewaren
+    LOG_SEGMENT,         // segment in het programma, seconden
+    LOG_QUEUE_DROPPED,   // verloren invoergebeurtenissen (modulo 256), verloren frames, beide totaal
+};
+
+class Logger {
+    byte buffer[LOG_BUFFER];
+    byte head;
+    byte tail;
+    unsigned int lost;
+
+    void header(byte id, byte size);
+    bool begin(byte id, byte size);
+    void put(unsigned int value);
+
+  public:
+    Logger();
+
+    void event(byte id);
+    void event(byte id, int a);
+    void event(byte id, int a, int b);
+
+    /* Zet zoveel berichten door naar het protocol als er in de zendbuffer past */
+    void drain();
+
+    /* Schrijf alles, ook als dat wacht. Alleen voor het slapen gaan. */
+    void flush();
+};
+
+extern Logger logger;
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(id, ...) logger.event(id, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(id, ...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(id, ...) logger.event(id, ##__VA_ARGS__)
+#else
+#define LOG_WARN(id, ...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(id, ...) logger.event(id, ##__VA_ARGS__)
+#else
+#define LOG_INFO(id, ...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(id, ...) logger.event(id, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(id, ...)
+#endif
+
+#endif //Log.h
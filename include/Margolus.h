@@ -0,0 +1,48 @@
+#ifndef Margolus_h
+#define Margolus_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Zand als blok-cellulaire automaat met een Margolus-buurt.
+ * Het bord wordt per stap verdeeld in blokken van 2x2, afwisselend met
+ * verschuiving 0 en 1. Elk blok gaat in een keer door een tabel van 16
+ * toestanden, dus de volgorde waarin de blokken worden bekeken maakt niet uit.
+ *
+ * Het bord is een bitboard in logische coordinaten: bit x van rows[y] is cel (x,y).
+ * Omlaag is (x-1, y+1), net als bij moveParticle().
+ */
+/*
+ * De twee regeltabellen: toestand van een blok in, toestand uit (bitvolgorde
+ * staat in Margolus.cpp). Ook gebruikt door tools/batchsim.cpp.
+ */
+extern const byte margolusRules[2][16] PROGMEM;
+
+class Margolus {
+    byte phase;
+    unsigned int seed;
+
+    byte nextRandom();
+
+  public:
+    Margolus();
+
+    /* Begin opnieuw met dit zaad, in de eerste fase */
+    void setSeed(unsigned int seed);
+
+    /*
+     * Voer een stap uit op een 8x8 bord.
+     * Returns :
+     * bool	true als er een korrel is verplaatst
+     */
+    bool step(byte rows[8]);
+
+    /* Wissel de verschuiving van de blokken, eenmaal per frame. */
+    void nextPhase();
+};
+
+#endif //Margolus.h
@@ -0,0 +1,51 @@
+#ifndef Melody_h
+#define Melody_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/* Een noot: toonhoogte en duur, en na hoeveel miliseconden de volgende noot begint */
+struct note {
+    unsigned int frequency;
+    unsigned int duration;
+    unsigned int next;
+};
+
+/*
+ * Speelt een reeks noten uit PROGMEM zonder te wachten. tone() loopt zelf op
+ * een timer; service() zet vanuit loop() de volgende noot klaar als die aan de
+ * beurt is. Een nieuwe play() onderbreekt de melodie die nog speelt.
+ */
+class Melody {
+    const note *notes;
+    byte count;
+    byte index;
+    byte pin;
+    unsigned long nextNote;
+
+  public:
+    Melody();
+
+    void begin(byte pin);
+
+    /*
+     * Begin een melodie.
+     * Params :
+     * notes	tabel in PROGMEM
+     * count	aantal noten
+     */
+    void play(const note *notes, byte count);
+
+    /* Speel de volgende noot als die aan de beurt is */
+    void service();
+
+    bool playing();
+
+    /* millis() waarop de volgende noot begint */
+    unsigned long deadline();
+};
+
+#endif //Melody.h
@@ -0,0 +1,36 @@
+#ifndef Memory_h
+#define Memory_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Bewaakt hoe dicht de stack bij de heap en de globale variabelen komt.
+ * Bij het opstarten, nog voor de constructors, wordt het vrije SRAM gevuld met
+ * MEMORY_CANARY. Hoeveel daarvan nog intact is, is de kleinste ruimte die er
+ * ooit tussen stack en heap over was.
+ */
+
+#define MEMORY_CANARY 0xC5
+
+// Minimaal aantal bytes dat er tussen stack en heap vrij moet blijven
+#ifndef MEMORY_GUARD
+#define MEMORY_GUARD 64
+#endif
+
+/* Het vrije SRAM tussen heap en stack op dit moment */
+int memoryFree();
+
+/* Het kleinste vrije SRAM sinds het opstarten (aantal bytes dat nog canary is) */
+int memoryHeadroom();
+
+/* Het grootste aantal bytes dat de stack ooit heeft gebruikt */
+int memoryStackUsed();
+
+/* true als de ruimte ooit kleiner is geweest dan MEMORY_GUARD */
+bool memoryGuardBreached();
+
+#endif //Memory.h
@@ -0,0 +1,123 @@
+#ifndef Neck_h
+#define Neck_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+#include "LedControl.h"
+
+// Maximaal aantal korrels per frame. Lopen we achter op het schema, dan
+// worden de gemiste korrels in volgende frames ingehaald, maximaal zoveel per frame.
+#ifndef NECK_MAX_BURST
+#define NECK_MAX_BURST 4
+#endif
+
+// Laat ook korrels door als de zandloper op zijn zij ligt (90 en 270 graden).
+// De hals ligt dan op halve hoogte: alleen zand dat tot de hals reikt stroomt door.
+#ifndef NECK_SIDEWAYS
+#define NECK_SIDEWAYS 1
+#endif
+
+// Laat de doorstroming afhangen van hoe ver de zandloper gekanteld is
+#ifndef NECK_TILT_FLOW
+#define NECK_TILT_FLOW 0
+#endif
+
+#define NECK_FLOW_FULL 255
+
+/*
+ * De twee cellen die samen de hals vormen, in logische (geroteerde) coordinaten.
+ * Korrels gaan van (fromX, fromY) op matrix 'from' naar (toX, toY) op matrix 'to'.
+ */
+struct neckCells {
+    byte from;
+    byte fromX;
+    byte fromY;
+    byte to;
+    byte toX;
+    byte toY;
+};
+
+/*
+ * Het schema is een tabel met per korrel de miliseconden sinds de vorige
+ * (zie Sequencer). Na de laatste korrel van de tabel laat de hals niets meer
+ * door tot er een nieuw schema begint.
+ */
+class Neck {
+    unsigned long nextDrop;
+    const unsigned int *steps;
+    byte count;
+    byte index;
+    byte flow;
+    unsigned int scale; // 256 * NECK_FLOW_FULL / flow
+
+    unsigned long step(byte i);
+    bool getCells(int gravity, neckCells &cells);
+
+  public:
+    /*
+     * Start een nieuw schema.
+     * Params :
+     * steps		per korrel de miliseconden sinds de vorige; blijft van de aanroeper
+     * count		aantal korrels in steps
+     * first		de korrel die nu aan de beurt is, 0 voor een nieuw schema
+     * firstDelay	miliseconden tot die korrel
+     */
+    void start(const unsigned int *steps, byte count, byte first, unsigned long firstDelay);
+
+    /* Ga verder in hetzelfde schema na een pauze: de volgende korrel over firstDelay miliseconden */
+    void resume(unsigned long firstDelay);
+
+    /* De korrel in de tabel die nu aan de beurt is, voor Persist */
+    byte position();
+
+    /* true als alle korrels van de tabel door de hals zijn */
+    bool finished();
+
+    /* Miliseconden tot de volgende grains korrels van het schema door de hals zijn */
+    unsigned long timeFor(byte grains);
+
+    /*
+     * Stel de doorstroming in (1..NECK_FLOW_FULL). Bij minder dan
+     * NECK_FLOW_FULL wordt de tijd tussen twee korrels evenredig langer.
+     */
+    void setFlow(byte flow);
+
+    /*
+     * Het aantal korrels dat nu door de hals moet (0..NECK_MAX_BURST).
+     * In een richting zonder hals wordt het schema opgeschoven,
+     * zodat er tijdens de pauze geen achterstand ontstaat.
+     */
+    byte due(int gravity);
+
+    /* Het aantal korrels dat nu aan de beurt is, ongeacht de richting (0..NECK_MAX_BURST). */
+    byte owed();
+
+    /* Een korrel is buiten transfer() om door de hals gegaan: schuif de deadline op. */
+    void advance();
+
+    /*
+     * Verplaats een korrel door de hals en schuif de deadline naar de volgende korrel.
+     * Geeft false terug als de bovenkant leeg, de onderkant bezet of het schema op is.
+     */
+    bool transfer(LedControl &lc, int gravity);
+
+    /* Sla een korrel over: het schema begint opnieuw vanaf nu. */
+    void skip();
+
+    /* millis() waarop de volgende korrel aan de beurt is */
+    unsigned long deadline();
+
+    /* De matrix waar de korrels naartoe stromen, of -1 zonder hals. */
+    int destination(int gravity);
+
+    /* De matrix waar de korrels uit stromen, of -1 zonder hals. */
+    int source(int gravity);
+
+    /* De cel waar een korrel binnenkomt, in logische coordinaten. */
+    coord entry(int gravity);
+};
+
+#endif //Neck.h
@@ -0,0 +1,94 @@
+#ifndef Particles_h
+#define Particles_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+#include "LedControl.h"
+
+// Maximaal aantal korrels. Elke korrel kost 8 bytes SRAM, dus niet meer dan
+// de zandloper nodig heeft: 128 korrels (beide matrices vol) zou 1 KB van de
+// 2 KB kosten, naast de rij-buffers, de logger en de stack. Op de ATmega is een
+// stap met 60 korrels geschat 18.000 tot 33.000 klokcycli (1,1 tot 2,1 ms),
+// met 128 tot 70.000 (4,4 ms); tools/particlecost.cpp meet het op de host,
+// waar de grens niet geldt.
+#ifndef PARTICLE_MAX
+#define PARTICLE_MAX 60
+#endif
+#if PARTICLE_MAX > 128
+#error "PARTICLE_MAX: er zijn maar 128 cellen"
+#endif
+#if PARTICLE_MAX > 64 && defined(__AVR__)
+#error "PARTICLE_MAX kost 8 bytes SRAM per korrel; meer dan 64 past niet naast de rest"
+#endif
+
+// Versnelling per frame bij 1g, in 1/64 van de ADC-uitslag (Q8.8: 256 = een cel)
+#ifndef PARTICLE_GAIN
+#define PARTICLE_GAIN 29
+#endif
+
+// Wrijving: elk frame verliest een korrel 1/2^PARTICLE_DAMPING van zijn snelheid
+#ifndef PARTICLE_DAMPING
+#define PARTICLE_DAMPING 4
+#endif
+
+// Maximale snelheid in Q8.8 cellen per frame, kleiner dan een cel zodat
+// een korrel nooit over een andere heen springt
+#define PARTICLE_VMAX 240
+
+/*
+ * Een korrel met positie en snelheid in Q8.8 wereldcoordinaten.
+ * De wereld is 16x16 cellen: matrix B ligt op (0..7, 0..7) en matrix A op
+ * (8..15, 8..15), in ruwe coordinaten. Pixel (7,7) van B en pixel (0,0) van A
+ * raken elkaar diagonaal: dat is de hals.
+ */
+struct grain {
+    int x;
+    int y;
+    int vx;
+    int vy;
+};
+
+class Particles {
+    grain grains[PARTICLE_MAX];
+    byte count;
+    /* Bezette cellen per matrix, in dezelfde bitvolgorde als LedControl::getRow */
+    byte occupied[2][8];
+    byte crossings;
+    byte frame;
+    unsigned long lastMicros;
+    unsigned long maxMicros;
+
+    bool isFree(int x, int y);
+    void setOccupied(int x, int y, bool state);
+    bool tryMove(grain &g, int nx, int ny, byte &budget);
+    bool spill(grain &g, byte &budget);
+
+  public:
+    /* Maak van elke brandende led een stilstaande korrel. */
+    void load(LedControl &lc);
+
+    /*
+     * Versnel alle korrels langs de gemeten zwaartekracht en verplaats ze.
+     * Params :
+     * gx, gy	zwaartekracht in ruwe coordinaten, in ADC-eenheden (70 is ongeveer 1g)
+     * budget	aantal korrels dat door de hals mag
+     * Returns :
+     * bool	true als er een korrel heeft bewogen
+     */
+    bool step(int gx, int gy, byte budget);
+
+    /* Schrijf de rijen die veranderd zijn naar de matrices. */
+    void render(LedControl &lc);
+
+    /* Aantal korrels dat in de laatste stap door de hals ging */
+    byte crossed();
+
+    /* Rekentijd van de laatste stap en het maximum, in microseconden */
+    unsigned long frameMicros();
+    unsigned long peakMicros();
+};
+
+#endif //Particles.h
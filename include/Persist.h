@@ -0,0 +1,99 @@
+#ifndef Persist_h
+#define Persist_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Bewaart de instellingen en de toestand van een lopende zandloper in EEPROM,
+ * zodat hij na stroomuitval verder gaat waar hij was.
+ *
+ * De records staan in een ring van PERSIST_SLOTS plaatsen. Elk nieuw record gaat
+ * naar de volgende plaats, zodat de slijtage over de hele ring wordt verdeeld.
+ * Bij het opstarten wint het geldige record (juiste versie en CRC) met het
+ * hoogste volgnummer. Schrijven gebeurt byte voor byte vanuit service(), de CRC
+ * als laatste: een half geschreven record is dus ongeldig en wordt overgeslagen.
+ * Het is een CRC-16, zodat zo'n record maar 1 op 65536 keer toevallig klopt.
+ */
+
+#define PERSIST_VERSION 3
+
+// Begin van de ring in EEPROM en het aantal plaatsen
+#ifndef PERSIST_BASE
+#define PERSIST_BASE 0
+#endif
+#ifndef PERSIST_SLOTS
+#define PERSIST_SLOTS 16
+#endif
+#define PERSIST_SLOT_SIZE 40
+
+// Minimale tijd tussen twee checkpoints. Met 16 plaatsen en 100.000 schrijfcycli
+// per cel is dat ruim 270 dagen onafgebroken lopen.
+#ifndef PERSIST_INTERVAL
+#define PERSIST_INTERVAL 15000UL
+#endif
+
+// Vlaggen
+#define PERSIST_RUNNING 0x01
+
+/* Kalibratie van de accelerometer, per as (0 = X, 1 = Y), in ADC-eenheden */
+struct calibration {
+    int zero[2];  // waarde bij 0g
+    int scale[2]; // uitslag bij 1g
+    int band[2];  // dode zone rond zero
+};
+
+struct persistRecord {
+    unsigned int sequence;
+    byte version;
+    byte mode;
+    calibration cal;
+    byte boards[16];       // rijen van matrix A en daarna B, zoals LedControl::getRow
+    byte transferred;      // korrels door de hals sinds het vullen
+    unsigned int nextDrop; // miliseconden tot de volgende korrel
+    byte segment;          // segment van het programma (Sequencer::index)
+    byte grain;            // korrel in dat segment (Neck::position)
+    byte flags;
+    uint16_t crc;
+};
+
+class Persist {
+    persistRecord pending;
+    byte slot;
+    byte written;
+    bool writing;
+    unsigned int sequence;
+    unsigned long lastCheckpoint;
+
+    uint16_t crc(const persistRecord &r);
+
+  public:
+    Persist();
+
+    /*
+     * Zoek het nieuwste geldige record.
+     * Returns :
+     * bool	false als er geen geldig record is
+     */
+    bool load(persistRecord &r);
+
+    /*
+     * Mag er een nieuw record worden geschreven? Niet zolang het vorige nog wordt
+     * geschreven, en niet binnen PERSIST_INTERVAL na het vorige (behalve met force).
+     */
+    bool ready(bool force = false);
+
+    /* Begin met het schrijven van een nieuw record op de volgende plaats */
+    void checkpoint(const persistRecord &r);
+
+    /* Schrijf verder aan het record, zonder te wachten op de EEPROM */
+    void service();
+
+    /* true zolang er nog een record wordt geschreven */
+    bool busy();
+};
+
+#endif //Persist.h
@@ -0,0 +1,54 @@
+#ifndef Power_h
+#define Power_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+// Na zoveel miliseconden zonder beweging, draaien of knop gaan de matrices uit,
+// maar pas als het zand van het lopende segment door de hals is
+#ifndef POWER_SHUTDOWN_AFTER
+#define POWER_SHUTDOWN_AFTER 60000UL
+#endif
+
+// Duur van een power-down slaap, tot de watchdog de processor wekt
+#define POWER_WDT_PERIOD 250
+
+/*
+ * Laat de ATmega slapen in plaats van te wachten met delay().
+ * Tussen twee frames gaat de processor in idle: Timer0 blijft lopen, dus millis()
+ * klopt en elke interrupt (timer, knop, seriele poort) maakt hem weer wakker.
+ * In standby gaat hij in power-down en wordt hij elke POWER_WDT_PERIOD door de
+ * watchdog of direct door de knop op INT0 gewekt.
+ */
+class PowerManager {
+    unsigned long statsStart;
+    unsigned long idleMicros;
+    unsigned long downMillis;
+
+  public:
+    /*
+     * Params :
+     * buttonPin	pin van de knop, moet een externe interrupt zijn (2 = INT0)
+     */
+    void begin(byte buttonPin);
+
+    /* Slaap in idle mode gedurende ms miliseconden */
+    void idle(unsigned long ms);
+
+    /* Slaap in power-down tot de watchdog afgaat of de knop wordt ingedrukt */
+    void powerDown();
+
+    /* Begin opnieuw met meten */
+    void resetStats();
+
+    /* Percentage van de tijd dat de processor wakker was sinds resetStats() */
+    byte dutyCycle();
+
+    /* Geslapen tijd sinds resetStats(), in miliseconden */
+    unsigned long sleptMillis();
+};
+
+#endif //Power.h
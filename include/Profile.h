@@ -0,0 +1,82 @@
+#ifndef Profile_h
+#define Profile_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Meetpunten voor het framebudget. Alleen actief met -D ZANDLOPER_PROFILE,
+ * anders doen alle macro's niets en kost het geen flash of SRAM.
+ *
+ * PROFILE_BEGIN(PROF_UPDATE);
+ * moved = updateMatrix();
+ * PROFILE_END(PROF_UPDATE);
+ */
+
+enum profileTimer {
+    PROF_GRAVITY,
+    PROF_UPDATE,
+    PROF_DROP,
+    PROF_DISPLAY,
+    PROF_COUNT,
+    PROF_PROTOCOL,
+    PROF_TIMERS
+};
+
+// Histogram van de looptijd: bucket n telt frames van 2^(n-1) tot 2^n microseconden
+#define PROFILE_BUCKETS 16
+
+struct profileTimerStats {
+    unsigned long total;
+    unsigned int calls;
+    unsigned int min;
+    unsigned int max;
+};
+
+struct profileData {
+    profileTimerStats timers[PROF_TIMERS];
+    profileTimerStats loop;
+    unsigned int histogram[PROFILE_BUCKETS];
+    unsigned long spiTransfers;
+    unsigned long spiBytes;
+    unsigned long grainsMoved;
+    unsigned long drops;
+    unsigned long deadlineMisses;
+};
+
+class Profile {
+    void add(profileTimerStats &stats, unsigned long t);
+
+  public:
+    profileData data;
+    /* micros() bij het eerste frame na de reset; reset() laat dit staan */
+    unsigned long firstFrame;
+
+    void reset();
+
+    /* Tel de tijd sinds start (micros()) bij een meetpunt op */
+    void stop(byte timer, unsigned long start);
+
+    /* Tel de duur van een heel frame, sinds start (micros()) */
+    void frame(unsigned long start);
+
+    /* Schrijf alle tellers naar de seriele poort */
+    void dump();
+};
+
+#ifdef ZANDLOPER_PROFILE
+extern Profile profile;
+#define PROFILE_BEGIN(t) unsigned long profileStart_##t = micros()
+#define PROFILE_END(t) profile.stop(t, profileStart_##t)
+#define PROFILE_COUNT(counter, n) (profile.data.counter += (n))
+#else
+// Een lege opdracht, zodat ook 'if (...) PROFILE_COUNT(...);' een body heeft
+#define PROFILE_BEGIN(t) ((void)0)
+#define PROFILE_END(t) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+#endif
+
+#endif //Profile.h
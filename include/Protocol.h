@@ -0,0 +1,100 @@
+#ifndef Protocol_h
+#define Protocol_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Binair protocol over de seriele poort, voor monitoren en testopstellingen.
+ * Een frame is: PROTOCOL_SYNC, type, lengte, payload, CRC-8 (poly 0x07) over
+ * type, lengte en payload. Getallen zijn little-endian.
+ * Verzenden gaat via een eigen ringbuffer die per frame wordt geleegd zolang
+ * de UART ruimte heeft; past een frame niet, dan wordt het overgeslagen.
+ * De host-kant staat in tools/zandloper.py.
+ */
+
+#ifndef PROTOCOL_BAUD
+#define PROTOCOL_BAUD 115200
+#endif
+
+// Grootte van de zendbuffer, een macht van 2
+#ifndef PROTOCOL_TX_BUFFER
+#define PROTOCOL_TX_BUFFER 64
+#endif
+
+#define PROTOCOL_SYNC 0x7E
+#define PROTOCOL_MAX_PAYLOAD 24
+
+// Houd deze lijst gelijk met tools/zandloper.py
+enum frameType {
+    FRAME_LOG = 0x01,   // logbericht: id, tijd, argumenten (zie Log.h)
+    FRAME_STATE = 0x02, // 16 rijen (A dan B), korrels A, korrels B, zwaartekracht (int16), mode
+    FRAME_MEMORY = 0x03, // vrij SRAM, kleinste vrije ruimte ooit, grootste stackgebruik (int16)
+    FRAME_CAPTURE = 0x04, // een blok van de invoeropname (zie Capture.h), leeg = einde van een dump
+    CMD_STREAM = 0x10,  // stuur elke n miliseconden een FRAME_STATE (uint16, 0 = uit)
+    CMD_MODE = 0x11,    // kies mode (index in modes[], daarna de programma's)
+    CMD_GRAVITY = 0x12, // forceer de richting (int16: 0, 90, 180, 270, -1; GRAVITY_AUTO = accelerometer)
+    CMD_RESET = 0x13,   // vul de zandloper opnieuw
+    CMD_PROFILE = 0x14, // stuur de meetpunten (alleen met ZANDLOPER_PROFILE)
+    CMD_MEMORY = 0x15,  // stuur een FRAME_MEMORY
+    CMD_CALIBRATE = 0x16, // start de kalibratie van de accelerometer, daarna: bevestig de volgende stand
+    CMD_CAPTURE = 0x17, // invoeropname: 0 = stuur de ring, 1 = bewaar de ring in EEPROM, 2 = stuur de bewaarde ring
+    CMD_PROGRAM = 0x18, // bewaar een programma (struct program, zie Sequencer.h) in EEPROM en begin ermee;
+                        // ontbrekende segmenten aan het eind mogen wegblijven
+};
+
+struct protocolFrame {
+    byte type;
+    byte length;
+    byte payload[PROTOCOL_MAX_PAYLOAD];
+};
+
+class Protocol {
+    byte tx[PROTOCOL_TX_BUFFER];
+    byte txHead;
+    byte txTail;
+
+    protocolFrame rx;
+    byte rxState;
+    byte rxPos;
+    byte rxCrc;
+
+    unsigned int dropped;
+
+    void push(byte b);
+
+  public:
+    Protocol();
+
+    void begin();
+
+    /*
+     * Zet een frame in de zendbuffer.
+     * Returns :
+     * bool	false als het frame niet past en is overgeslagen
+     */
+    bool send(byte type, const byte *payload, byte length);
+
+    /*
+     * Verwerk ontvangen bytes.
+     * Returns :
+     * bool	true als frame een compleet, geldig commando bevat
+     */
+    bool receive(protocolFrame &frame);
+
+    /* Schrijf zoveel naar de UART als er zonder wachten in past */
+    void service();
+
+    /* Schrijf alles, ook als dat wacht */
+    void flush();
+
+    /* Aantal frames dat niet in de zendbuffer paste */
+    unsigned int droppedFrames();
+};
+
+extern Protocol protocol;
+
+#endif //Protocol.h
@@ -0,0 +1,86 @@
+#ifndef Queue_h
+#define Queue_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+// Compiler barrier: het element moet geschreven (gelezen) zijn voordat de index
+// verandert. Op de AVR is een byte lezen of schrijven al atomair; op de host
+// (tools/) is ook een echte geheugenbarriere nodig.
+#ifdef __AVR__
+#define QUEUE_BARRIER() asm volatile("" ::: "memory")
+#else
+#define QUEUE_BARRIER() __sync_synchronize()
+#endif
+
+/*
+ * Ringbuffer met een vaste grootte voor precies een schrijver en een lezer,
+ * bijvoorbeeld een interrupt en loop(). Er is geen cli() nodig: alleen de
+ * schrijver verandert head en alleen de lezer verandert tail, en beide zijn
+ * een byte. De indices lopen vrij door van 0 tot 255; Size moet daarom een
+ * macht van twee zijn van hooguit 128.
+ */
+template <typename T, byte Size>
+class Queue {
+    static_assert(Size > 0 && Size <= 128 && (Size & (Size - 1)) == 0, "Size moet een macht van twee zijn, hooguit 128");
+
+    T items[Size];
+    volatile byte head;
+    volatile byte tail;
+    volatile byte lost;
+
+  public:
+    Queue() : head(0), tail(0), lost(0) {}
+
+    /* Alleen voor de schrijver. Geeft false (en telt het verlies) als de buffer vol is. */
+    bool push(const T &item)
+    {
+        byte h = head;
+
+        if ((byte)(h - tail) == Size)
+        {
+            lost++;
+            return false;
+        }
+        items[h & (Size - 1)] = item;
+        QUEUE_BARRIER();
+        head = h + 1;
+        return true;
+    }
+
+    /* Alleen voor de lezer. Geeft false als de buffer leeg is. */
+    bool pop(T &item)
+    {
+        byte t = tail;
+
+        if (t == head)
+            return false;
+        item = items[t & (Size - 1)];
+        QUEUE_BARRIER();
+        tail = t + 1;
+        return true;
+    }
+
+    /* Alleen voor de lezer: gooi alles weg wat er nu in staat */
+    void clear()
+    {
+        tail = head;
+    }
+
+    /* Aantal elementen dat klaarstaat */
+    byte count()
+    {
+        return (byte)(head - tail);
+    }
+
+    /* Aantal elementen dat niet meer paste. Alleen de schrijver telt, dus bij benadering. */
+    byte dropped()
+    {
+        return lost;
+    }
+};
+
+#endif //Queue.h
@@ -0,0 +1,111 @@
+#ifndef Sequencer_h
+#define Sequencer_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+/*
+ * Tijdprogramma's voor de zandloper: een reeks segmenten, elk met een duur,
+ * een aantal korrels en een vorm van de doorstroming, eventueel een paar keer
+ * herhaald. Een gewone mode is een programma met een gelijkmatig segment.
+ *
+ * Bij het begin van een segment wordt het omgerekend naar een tabel met per
+ * korrel de miliseconden sinds de vorige korrel (compile()). De Neck loopt die
+ * tabel af, zodat elke korrel O(1) kost, zonder deling. De tijden worden in
+ * fixed point berekend met een tabel van reciproken; de laatste korrel valt
+ * precies op de duur van het segment.
+ *
+ * Na een segment geeft de cue aan wat er gebeurt: doorlopen met het zand dat
+ * er nog is, een signaal waarna de zandloper moet worden omgedraaid, of een
+ * signaal waarna het zand vanzelf weer boven ligt.
+ */
+
+// Grootste aantal korrels in een segment, en segmenten in een programma
+#define SEQUENCER_MAX_GRAINS 60
+#define SEQUENCER_MAX_SEGMENTS 5
+
+// Het programma dat met CMD_PROGRAM is ingesteld, achter de ring van Capture
+#define SEQUENCER_EEPROM_BASE 1000
+
+// Vorm van de doorstroming binnen een segment (onderste 4 bits van segment.shape)
+#define FLOW_EVEN 0       // gelijkmatig
+#define FLOW_FAST_START 1 // snel begin, trage staart
+#define FLOW_SLOW_START 2 // traag begin, snelle staart
+#define FLOW_MASK 0x0F
+
+// Wat er na een segment gebeurt (bovenste 4 bits van segment.shape)
+#define CUE_NONE 0x00   // het volgende segment gaat verder met het zand dat er nog is
+#define CUE_FLIP 0x10   // signaal; het volgende segment begint als de zandloper is omgedraaid
+#define CUE_REFILL 0x20 // signaal; het zand ligt meteen weer boven
+#define CUE_MASK 0xF0
+
+/* Een segment; 4 bytes, ook op de host, zodat CMD_PROGRAM het zo kan versturen */
+struct segment {
+    uint16_t seconds;
+    byte grains; // 1..SEQUENCER_MAX_GRAINS
+    byte shape;  // FLOW_* | CUE_*
+};
+
+struct program {
+    byte repeat; // het hele programma zoveel keer
+    byte count;  // aantal segmenten
+    segment segments[SEQUENCER_MAX_SEGMENTS];
+};
+
+class Sequencer {
+    program current;
+    unsigned int steps[SEQUENCER_MAX_GRAINS];
+    byte position; // in het uitgerolde programma
+    byte part;     // in current.segments
+
+    const segment &active();
+    void compile();
+
+  public:
+    /*
+     * Begin een programma.
+     * Params :
+     * p		het programma, wordt gekopieerd
+     * position	segment in het uitgerolde programma (herhaling * count + segment)
+     */
+    void begin(const program &p, byte position);
+
+    /* Een gewoon programma: een gelijkmatig segment van seconds met grains korrels */
+    void begin(unsigned int seconds, byte grains);
+
+    /*
+     * Ga naar het volgende segment.
+     * Returns : false na het laatste segment, dat dan actief blijft
+     */
+    bool next();
+
+    /* true als het actieve segment het laatste is */
+    bool last();
+
+    /* Het segment in het uitgerolde programma, voor Persist */
+    byte index();
+
+    /* De cue na het actieve segment (CUE_*) */
+    byte cue();
+
+    /* Duur van het actieve segment in seconden */
+    unsigned int seconds();
+
+    /* De tabel van het actieve segment: per korrel de miliseconden sinds de vorige */
+    const unsigned int *table();
+    byte grains();
+
+    /* Returns : true als p past: segmenten, korrels en hooguit 65535 ms tussen twee korrels */
+    static bool valid(const program &p);
+
+    /* Het programma uit EEPROM. Returns : false zonder geldig programma */
+    static bool read(program &p);
+
+    /* Bewaar p in EEPROM; schrijft alleen de bytes die veranderen */
+    static void write(const program &p);
+};
+
+#endif //Sequencer.h
@@ -0,0 +1,85 @@
+#include "Animation.h"
+
+Animation::Animation()
+{
+    for (byte i = 0; i < ANIM_CHANNELS; i++)
+    {
+        frames[i] = NULL;
+        value[i] = 0;
+    }
+}
+
+void Animation::play(byte channel, const keyframe *f, byte c, bool r)
+{
+    if (channel >= ANIM_CHANNELS || c == 0)
+        return;
+    frames[channel] = f;
+    count[channel] = c;
+    repeat[channel] = r;
+    start[channel] = millis();
+}
+
+void Animation::stop(byte channel)
+{
+    if (channel < ANIM_CHANNELS)
+        frames[channel] = NULL;
+}
+
+bool Animation::playing(byte channel)
+{
+    return channel < ANIM_CHANNELS && frames[channel] != NULL;
+}
+
+byte Animation::sample(byte channel, unsigned long t)
+{
+    keyframe a, b;
+
+    memcpy_P(&a, &frames[channel][0], sizeof(keyframe));
+    for (byte i = 1; i < count[channel]; i++)
+    {
+        memcpy_P(&b, &frames[channel][i], sizeof(keyframe));
+        if (t < b.time)
+            return a.value + ((long)(b.value - a.value) * (long)(t - a.time)) / (long)(b.time - a.time);
+        a = b;
+    }
+    return a.value;
+}
+
+byte Animation::update()
+{
+    byte changed = 0;
+
+    for (byte channel = 0; channel < ANIM_CHANNELS; channel++)
+    {
+        if (frames[channel] == NULL)
+            continue;
+
+        keyframe last;
+        memcpy_P(&last, &frames[channel][count[channel] - 1], sizeof(keyframe));
+        unsigned long t = millis() - start[channel];
+        bool finished = false;
+
+        if (t >= last.time)
+        {
+            if (repeat[channel] && last.time > 0)
+                t %= last.time;
+            else
+                finished = true;
+        }
+
+        byte v = finished ? last.value : sample(channel, t);
+        if (finished)
+            frames[channel] = NULL;
+        if (v != value[channel])
+        {
+            value[channel] = v;
+            changed |= 1 << channel;
+        }
+    }
+    return changed;
+}
+
+byte Animation::get(byte channel)
+{
+    return channel < ANIM_CHANNELS ? value[channel] : 0;
+}
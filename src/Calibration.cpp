@@ -0,0 +1,72 @@
+#include "Calibration.h"
+
+Calibrator::Calibrator()
+{
+    measured = 0;
+    lastSpread = 0;
+}
+
+bool Calibrator::sample(byte orientation, byte pinX, byte pinY)
+{
+    byte pins[2] = {pinX, pinY};
+    long sum[2] = {0, 0};
+    int low[2] = {1023, 1023};
+    int high[2] = {0, 0};
+
+    if (orientation > 3)
+        return false;
+    for (byte i = 0; i < CAL_SAMPLES; i++)
+    {
+        for (byte axis = 0; axis < 2; axis++)
+        {
+            int value = analogRead(pins[axis]);
+            sum[axis] += value;
+            if (value < low[axis])
+                low[axis] = value;
+            if (value > high[axis])
+                high[axis] = value;
+        }
+        delay(2);
+    }
+
+    lastSpread = max(high[0] - low[0], high[1] - low[1]);
+    if (lastSpread > CAL_MAX_NOISE)
+        return false;
+    for (byte axis = 0; axis < 2; axis++)
+        mean[orientation][axis] = (sum[axis] + CAL_SAMPLES / 2) / CAL_SAMPLES;
+    measured |= 1 << orientation;
+    return true;
+}
+
+int Calibrator::spread()
+{
+    return lastSpread;
+}
+
+bool Calibrator::complete()
+{
+    return measured == 0x0F;
+}
+
+bool Calibrator::compute(calibration &cal)
+{
+    calibration result;
+
+    if (!complete())
+        return false;
+
+    // X: laag bij 0 graden, hoog bij 180. Y: hoog bij 90, laag bij 270.
+    result.zero[0] = (mean[0][0] + mean[2][0]) / 2;
+    result.scale[0] = (mean[2][0] - mean[0][0]) / 2;
+    result.zero[1] = (mean[1][1] + mean[3][1]) / 2;
+    result.scale[1] = (mean[1][1] - mean[3][1]) / 2;
+
+    for (byte axis = 0; axis < 2; axis++)
+    {
+        if (result.scale[axis] < CAL_MIN_SCALE)
+            return false;
+        result.band[axis] = ((long)result.scale[axis] * CAL_BAND) >> 6;
+    }
+    cal = result;
+    return true;
+}
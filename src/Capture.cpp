@@ -0,0 +1,351 @@
+#include "Capture.h"
+#include "Log.h"
+#include <avr/eeprom.h>
+
+#if CAPTURE
+Capture capture;
+
+#if CAPTURE == CAPTURE_RING
+static_assert(CAPTURE_RING_SIZE + 2 <= CAPTURE_EEPROM_SIZE, "de ring past niet in het EEPROM");
+#endif
+
+// Tag en een uint16 voor een grote dt
+#define TAG_MAX 3
+
+Capture::Capture()
+{
+    used = 0;
+    sequence = 0;
+    haveSample = false;
+    lost = 0;
+#if CAPTURE == CAPTURE_RING
+    tail = 0;
+    filled = 0;
+    saving = false;
+    sinceSnapshot = 0;
+#else
+    requested = false;
+#endif
+}
+
+// Zorg voor ruimte voor een record met length bytes na de tag; zo nodig in een nieuw blok
+bool Capture::reserve(unsigned long time, byte length)
+{
+#if CAPTURE == CAPTURE_RING
+    if (saving)
+    {
+        lost++;
+        return false;
+    }
+#endif
+    if (used > 0 && (used + TAG_MAX + length > PROTOCOL_MAX_PAYLOAD || (long)(time - lastTime) > 65535L))
+        close();
+    if (used == 0)
+    {
+        chunk[0] = sequence++;
+        for (byte i = 0; i < 4; i++)
+            chunk[1 + i] = time >> (8 * i);
+        used = CAPTURE_HEADER;
+        chunkStart = time;
+        lastTime = time;
+        // Het eerste monster van een blok is altijd volledig
+        haveSample = false;
+    }
+    return true;
+}
+
+void Capture::tag(byte type, unsigned long time)
+{
+    unsigned int dt = 0;
+
+    // Een gebeurtenis die ouder is dan het vorige record krijgt dezelfde tijd
+    if ((long)(time - lastTime) > 0)
+    {
+        dt = time - lastTime;
+        lastTime = time;
+    }
+    if (dt < CAPTURE_DT_ESCAPE)
+        put(type << 5 | dt);
+    else
+    {
+        put(type << 5 | CAPTURE_DT_ESCAPE);
+        put16(dt);
+    }
+}
+
+void Capture::put(byte b)
+{
+    chunk[used++] = b;
+}
+
+void Capture::put16(unsigned int value)
+{
+    put(value & 0xFF);
+    put(value >> 8);
+}
+
+void Capture::putSample(int x, int y)
+{
+    put(x & 0xFF);
+    put(y & 0xFF);
+    put(((x >> 8) & 0x03) | (((y >> 8) & 0x03) << 2));
+}
+
+void Capture::sample(int x, int y, unsigned long time, bool read)
+{
+    if (!reserve(time, 3))
+        return;
+
+    int dx = x - lastX;
+    int dy = y - lastY;
+
+    if (read)
+    {
+        tag(CAP_READ, time);
+        putSample(x, y);
+    }
+    else if (haveSample && dx == 0 && dy == 0)
+        tag(CAP_SAME, time);
+    else if (haveSample && dx >= -8 && dx <= 7 && dy >= -8 && dy <= 7)
+    {
+        tag(CAP_DELTA, time);
+        put(((dx & 0x0F) << 4) | (dy & 0x0F));
+    }
+    else
+    {
+        tag(CAP_SAMPLE, time);
+        putSample(x, y);
+    }
+    lastX = x;
+    lastY = y;
+    haveSample = true;
+}
+
+void Capture::button(bool down, unsigned long time)
+{
+    if (reserve(time, 0))
+        tag(down ? CAP_BUTTON_DOWN : CAP_BUTTON_UP, time);
+}
+
+void Capture::command(const protocolFrame &frame)
+{
+    // Een lange payload, zoals CMD_PROGRAM, gaat in delen die elk in een leeg blok passen
+    const byte part = PROTOCOL_MAX_PAYLOAD - CAPTURE_HEADER - TAG_MAX - 2;
+    unsigned long now = millis();
+    byte done = 0;
+
+    do
+    {
+        byte length = min((byte)(frame.length - done), part);
+        bool more = done + length < frame.length;
+
+        if (!reserve(now, 2 + length))
+            return;
+        tag(CAP_COMMAND, now);
+        put(frame.type);
+        put(more ? length | CAPTURE_MORE : length);
+        for (byte i = 0; i < length; i++)
+            put(frame.payload[done + i]);
+        done += length;
+    } while (done < frame.length);
+}
+
+void Capture::info(byte kind, const byte *data, byte length, unsigned long time)
+{
+    if (!reserve(time, 1 + length))
+        return;
+    tag(CAP_INFO, time);
+    put(kind);
+    for (byte i = 0; i < length; i++)
+        put(data[i]);
+}
+
+// Miliseconden tussen then en het frame, begrensd op een uint16
+static void putAgo(byte *p, unsigned long time, unsigned long then)
+{
+    unsigned long ago = time - then;
+
+    if (ago > 65535UL)
+        ago = 65535UL;
+    p[0] = ago & 0xFF;
+    p[1] = ago >> 8;
+}
+
+void Capture::snapshot(const persistRecord &r, const captureMoment &m)
+{
+    byte state[7] = {r.mode, r.transferred, r.flags, (byte)(r.nextDrop & 0xFF), (byte)(r.nextDrop >> 8), r.segment, r.grain};
+    // Altijd int16, ook op de host waar een int 32 bits is
+    byte cal[sizeof(calibration) / sizeof(int) * 2];
+    const int *values = &r.cal.zero[0];
+    byte seed[11] = {(byte)(m.seed & 0xFF), (byte)(m.seed >> 8), m.reason};
+
+    for (byte i = 0; i < sizeof(calibration) / sizeof(int); i++)
+    {
+        cal[2 * i] = values[i] & 0xFF;
+        cal[2 * i + 1] = values[i] >> 8;
+    }
+    putAgo(&seed[3], m.time, m.fixed);
+    putAgo(&seed[5], m.time, m.active);
+    putAgo(&seed[7], m.time, m.frame);
+    seed[9] = m.gravity & 0xFF;
+    seed[10] = m.gravity >> 8;
+#if CAPTURE == CAPTURE_RING
+    sinceSnapshot = 0;
+#endif
+    // Alle records op de tijd van het frame, zodat tools/replay de momentopname in hetzelfde frame vraagt
+    info(CAP_INFO_STATE, state, sizeof(state), m.time);
+    info(CAP_INFO_CAL, cal, sizeof(cal), m.time);
+    info(CAP_INFO_BOARD, r.boards, sizeof(r.boards), m.time);
+    info(CAP_INFO_SEED, seed, sizeof(seed), m.time);
+}
+
+bool Capture::snapshotDue(unsigned long now)
+{
+#if CAPTURE == CAPTURE_RING
+    return !saving && sinceSnapshot >= CAPTURE_SNAPSHOT_BYTES;
+#else
+    if (!requested || (long)(now - requestAt) < 0)
+        return false;
+    requested = false;
+    return true;
+#endif
+}
+
+bool Capture::request(unsigned long time)
+{
+#if CAPTURE == CAPTURE_RING
+    return false;
+#else
+    if (requested)
+        return false;
+    requested = true;
+    requestAt = time;
+    return true;
+#endif
+}
+
+void Capture::close()
+{
+    if (used == 0)
+        return;
+#if CAPTURE == CAPTURE_RING
+    store();
+#else
+    // Met een gat is de opname niet na te spelen: liever even wachten tot de
+    // zendbuffer leeg is, zoals bij een momentopname die drie blokken beslaat
+    if (!protocol.send(FRAME_CAPTURE, chunk, used))
+    {
+        protocol.flush();
+        protocol.send(FRAME_CAPTURE, chunk, used);
+    }
+#endif
+    used = 0;
+}
+
+#if CAPTURE == CAPTURE_RING
+void Capture::store()
+{
+    unsigned int head;
+
+    while (CAPTURE_RING_SIZE - filled < used + 1)
+    {
+        byte length = ring[tail] + 1;
+        tail = (tail + length) % CAPTURE_RING_SIZE;
+        filled -= length;
+    }
+    head = (tail + filled) % CAPTURE_RING_SIZE;
+    ring[head] = used;
+    for (byte i = 0; i < used; i++)
+        ring[(head + 1 + i) % CAPTURE_RING_SIZE] = chunk[i];
+    filled += used + 1;
+    sinceSnapshot += used + 1;
+}
+#endif
+
+void Capture::service()
+{
+#if CAPTURE == CAPTURE_RING
+    // Eerst de lengte, dan de blokken vanaf het oudste, een byte als het EEPROM klaar is
+    while (saving && eeprom_is_ready())
+    {
+        byte b;
+        if (saved < 2)
+            b = filled >> (8 * saved);
+        else
+            b = ring[(tail + saved - 2) % CAPTURE_RING_SIZE];
+        eeprom_update_byte((byte *)(CAPTURE_EEPROM_BASE + saved), b);
+        if (++saved == filled + 2)
+        {
+            saving = false;
+            LOG_INFO(LOG_CAPTURE_SAVED, filled, lost);
+        }
+    }
+    // Meld wat er tijdens het bewaren niet in de ring kon
+    if (lost > 0 && !saving)
+    {
+        byte n[2] = {(byte)(lost & 0xFF), (byte)(lost >> 8)};
+        lost = 0;
+        info(CAP_INFO_LOST, n, sizeof(n), millis());
+    }
+#else
+    if (used > 0 && millis() - chunkStart >= CAPTURE_FLUSH)
+        close();
+#endif
+}
+
+void Capture::action(byte what)
+{
+    byte block[PROTOCOL_MAX_PAYLOAD];
+
+    close();
+    switch (what)
+    {
+#if CAPTURE == CAPTURE_RING
+    case CAPTURE_DUMP:
+    {
+        unsigned int i = 0;
+
+        while (i < filled)
+        {
+            byte length = ring[(tail + i) % CAPTURE_RING_SIZE];
+            for (byte j = 0; j < length; j++)
+                block[j] = ring[(tail + i + 1 + j) % CAPTURE_RING_SIZE];
+            protocol.send(FRAME_CAPTURE, block, length);
+            protocol.flush();
+            i += length + 1;
+        }
+        break;
+    }
+    case CAPTURE_SAVE:
+        if (!saving && filled > 0)
+        {
+            saving = true;
+            saved = 0;
+        }
+        return;
+#endif
+    case CAPTURE_DUMP_SAVED:
+    {
+        unsigned int total = eeprom_read_word((const uint16_t *)CAPTURE_EEPROM_BASE);
+        unsigned int i = 0;
+
+        if (total > CAPTURE_EEPROM_SIZE - 2)
+            total = 0;
+        while (i < total)
+        {
+            byte length = eeprom_read_byte((const byte *)(CAPTURE_EEPROM_BASE + 2 + i));
+            if (length > PROTOCOL_MAX_PAYLOAD || i + 1 + length > total)
+                break;
+            eeprom_read_block(block, (const void *)(CAPTURE_EEPROM_BASE + 3 + i), length);
+            protocol.send(FRAME_CAPTURE, block, length);
+            protocol.flush();
+            i += length + 1;
+        }
+        break;
+    }
+    }
+    // Een leeg frame sluit de dump af
+    protocol.send(FRAME_CAPTURE, block, 0);
+    protocol.flush();
+}
+#endif
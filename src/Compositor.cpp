@@ -0,0 +1,88 @@
+#include "Compositor.h"
+
+Compositor::Compositor()
+{
+    memset(overlay, 0, sizeof(overlay));
+    blend = BLEND_OR;
+    active = false;
+    forced = false;
+}
+
+byte Compositor::compose(byte sand, byte over)
+{
+    switch (blend)
+    {
+    case BLEND_XOR:
+        return sand ^ over;
+    case BLEND_MASK:
+        return sand & ~over;
+    case BLEND_REPLACE:
+        return over;
+    default:
+        return sand | over;
+    }
+}
+
+void Compositor::clear(byte addr)
+{
+    if (addr < COMPOSITOR_DEVICES)
+        memset(overlay[addr], 0, 8);
+}
+
+void Compositor::setRow(byte addr, byte row, byte value)
+{
+    if (addr < COMPOSITOR_DEVICES && row < 8)
+        overlay[addr][row] = value;
+}
+
+void Compositor::show(LedControl &lc, blendMode mode)
+{
+    // Wat er nu op de matrices staat is onbekend: de eerste flush stuurt alles
+    if (!active)
+        forced = true;
+    blend = mode;
+    active = true;
+    lc.hold(true);
+    flush(lc);
+}
+
+void Compositor::hide(LedControl &lc)
+{
+    if (!active)
+        return;
+    // Met een lege overlay is de combinatie het zand zelf
+    memset(overlay, 0, sizeof(overlay));
+    blend = BLEND_OR;
+    flush(lc);
+    active = false;
+    lc.hold(false);
+}
+
+bool Compositor::visible()
+{
+    return active;
+}
+
+void Compositor::flush(LedControl &lc)
+{
+    byte values[COMPOSITOR_DEVICES];
+
+    if (!active)
+        return;
+    for (byte row = 0; row < 8; row++)
+    {
+        bool changed = forced;
+        for (byte addr = 0; addr < COMPOSITOR_DEVICES; addr++)
+        {
+            values[addr] = compose(lc.getRow(addr, row), overlay[addr][row]);
+            if (values[addr] != shown[addr][row])
+                changed = true;
+        }
+        if (!changed)
+            continue;
+        lc.showRow(row, values);
+        for (byte addr = 0; addr < COMPOSITOR_DEVICES; addr++)
+            shown[addr][row] = values[addr];
+    }
+    forced = false;
+}
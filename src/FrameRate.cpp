@@ -0,0 +1,60 @@
+#include "FrameRate.h"
+
+FrameRate::FrameRate()
+{
+    lastFrame = 0;
+    lastActive = 0;
+}
+
+void FrameRate::activity()
+{
+    lastActive = millis();
+}
+
+unsigned long FrameRate::period()
+{
+    return (millis() - lastActive < FRAME_ACTIVE_HOLD) ? FRAME_FAST : FRAME_IDLE;
+}
+
+unsigned long FrameRate::remaining(unsigned long deadline)
+{
+    unsigned long now = millis();
+    unsigned long next = lastFrame + period();
+
+    // Niet later wakker worden dan de volgende korrel, maar ook niet vaker dan FRAME_FAST
+    if ((long)(deadline - next) < 0)
+    {
+        next = deadline;
+        if ((long)(next - (lastFrame + FRAME_FAST)) < 0)
+            next = lastFrame + FRAME_FAST;
+    }
+    if ((long)(next - now) <= 0)
+        return 0;
+    return next - now;
+}
+
+void FrameRate::frame()
+{
+    lastFrame = millis();
+}
+
+unsigned long FrameRate::idleTime()
+{
+    return millis() - lastActive;
+}
+
+unsigned long FrameRate::frameStart()
+{
+    return lastFrame;
+}
+
+unsigned long FrameRate::lastActivity()
+{
+    return lastActive;
+}
+
+void FrameRate::resume(unsigned long frame, unsigned long active)
+{
+    lastFrame = frame;
+    lastActive = active;
+}
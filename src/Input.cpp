@@ -0,0 +1,86 @@
+#include "Input.h"
+
+Input input;
+
+static void buttonInterrupt()
+{
+    input.buttonChanged();
+}
+
+ISR(ADC_vect)
+{
+    input.conversionDone();
+}
+
+void Input::begin(byte button, byte pinX, byte pinY)
+{
+    buttonPin = button;
+    // Net als analogRead(): A0 is kanaal 0
+    channelX = (pinX >= A0 ? pinX - A0 : pinX) & 0x07;
+    channelY = (pinY >= A0 ? pinY - A0 : pinY) & 0x07;
+    attach();
+}
+
+void Input::attach()
+{
+    attachInterrupt(digitalPinToInterrupt(buttonPin), buttonInterrupt, CHANGE);
+}
+
+void Input::sample()
+{
+    finish();
+    ADMUX = _BV(REFS0) | channelX; // AVcc als referentie, zoals analogRead()
+    ADCSRA |= _BV(ADIE) | _BV(ADSC);
+}
+
+void Input::finish()
+{
+    while (ADCSRA & _BV(ADIE))
+        ;
+}
+
+bool Input::next(inputEvent &event)
+{
+    return events.pop(event);
+}
+
+void Input::clear()
+{
+    events.clear();
+}
+
+byte Input::dropped()
+{
+    return events.dropped();
+}
+
+void Input::buttonChanged()
+{
+    inputEvent e;
+
+    e.type = EVENT_BUTTON;
+    e.value = digitalRead(buttonPin);
+    e.time = millis();
+    events.push(e);
+}
+
+void Input::conversionDone()
+{
+    inputEvent e;
+
+    e.value = ADC;
+    e.time = millis();
+    if ((ADMUX & 0x07) == channelX)
+    {
+        e.type = EVENT_ADC_X;
+        // Direct door met Y; het kanaal wisselen mag zodra de conversie klaar is
+        ADMUX = _BV(REFS0) | channelY;
+        ADCSRA |= _BV(ADSC);
+    }
+    else
+    {
+        e.type = EVENT_ADC_Y;
+        ADCSRA &= ~_BV(ADIE);
+    }
+    events.push(e);
+}
@@ -26,6 +26,7 @@
 
 
 #include "LedControl.h"
+#include "Profile.h"
 
 //the opcodes for the MAX7221 and MAX7219
 #define OP_NOOP   0
@@ -50,23 +51,28 @@ LedControl::LedControl(int dataPin, int clkPin, int csPin, int numDevices) {
     if(numDevices<=0 || numDevices>8 )
         numDevices=8;
     maxDevices=numDevices;
+    rotation=0;
+    held=false;
+    for(int i=0;i<64;i++)
+        status[i]=0x00;
+}
+
+void LedControl::begin(int intensity) {
     pinMode(SPI_MOSI,OUTPUT);
     pinMode(SPI_CLK,OUTPUT);
     pinMode(SPI_CS,OUTPUT);
     digitalWrite(SPI_CS,HIGH);
-    SPI_MOSI=dataPin;
-    for(int i=0;i<64;i++)
-        status[i]=0x00;
-    for(int i=0;i<maxDevices;i++) {
-        spiTransfer(i,OP_DISPLAYTEST,0);
-        //scanlimit is set to max on startup
-        setScanLimit(i,7);
-        //decode is done in source
-        spiTransfer(i,OP_DECODEMODE,0);
-        clearDisplay(i);
-        //we go into shutdown-mode on startup
-        shutdown(i,true);
-    }
+    //every register is written to the whole chain in a single transaction
+    spiTransferAll(OP_DISPLAYTEST,0);
+    //scanlimit is set to max on startup
+    spiTransferAll(OP_SCANLIMIT,7);
+    //decode is done in source
+    spiTransferAll(OP_DECODEMODE,0);
+    if(intensity>=0 && intensity<16)
+        spiTransferAll(OP_INTENSITY,intensity);
+    //clear while still in shutdown, so no stale pixels show up
+    setAll(status);
+    spiTransferAll(OP_SHUTDOWN,1);
 }
 
 int LedControl::getDeviceCount() {
@@ -96,6 +102,11 @@ void LedControl::setIntensity(int addr, int intensity) {
         spiTransfer(addr, OP_INTENSITY,intensity);
 }
 
+void LedControl::setIntensityAll(int intensity) {
+    if(intensity>=0 && intensity<16)
+        spiTransferAll(OP_INTENSITY,intensity);
+}
+
 void LedControl::clearDisplay(int addr) {
     int offset;
 
@@ -238,6 +249,14 @@ void LedControl::setRow(int addr, int row, byte value) {
     spiTransfer(addr, row+1,status[offset+row]);
 }
 
+byte LedControl::getRow(int addr, int row) {
+    if(addr<0 || addr>=maxDevices)
+        return 0;
+    if(row<0 || row>7)
+        return 0;
+    return status[addr*8+row];
+}
+
 void LedControl::setColumn(int addr, int col, byte value) {
     byte val;
 
@@ -293,6 +312,12 @@ void LedControl::spiTransfer(int addr, volatile byte opcode, volatile byte data)
     //Create an array with the data to shift out
     int offset=addr*2;
     int maxbytes=maxDevices*2;
+    //while held only the stored state changes, the display is written with showRow()
+    if(held && opcode>=OP_DIGIT0 && opcode<=OP_DIGIT7)
+        return;
+    PROFILE_BEGIN(PROF_DISPLAY);
+    PROFILE_COUNT(spiTransfers, 1);
+    PROFILE_COUNT(spiBytes, maxbytes);
 
     for(int i=0;i<maxbytes;i++)
         spidata[i]=(byte)0;
@@ -306,18 +331,61 @@ void LedControl::spiTransfer(int addr, volatile byte opcode, volatile byte data)
         shiftOut(SPI_MOSI,SPI_CLK,MSBFIRST,spidata[i-1]);
     //latch the data onto the display
     digitalWrite(SPI_CS,HIGH);
+    PROFILE_END(PROF_DISPLAY);
+}
+
+void LedControl::spiTransferChain(byte opcode, const byte *data) {
+    int maxbytes=maxDevices*2;
+    PROFILE_BEGIN(PROF_DISPLAY);
+    PROFILE_COUNT(spiTransfers, 1);
+    PROFILE_COUNT(spiBytes, maxbytes);
+
+    for(int addr=0;addr<maxDevices;addr++) {
+        spidata[addr*2+1]=opcode;
+        spidata[addr*2]=data[addr];
+    }
+    digitalWrite(SPI_CS,LOW);
+    for(int i=maxbytes;i>0;i--)
+        shiftOut(SPI_MOSI,SPI_CLK,MSBFIRST,spidata[i-1]);
+    digitalWrite(SPI_CS,HIGH);
+    PROFILE_END(PROF_DISPLAY);
+}
+
+void LedControl::spiTransferAll(byte opcode, byte data) {
+    byte all[8];
+
+    memset(all, data, sizeof(all));
+    spiTransferChain(opcode, all);
+}
+
+void LedControl::setAll(const byte *rows) {
+    byte data[8];
+
+    //begin() sends status itself; memcpy may not copy a buffer onto itself
+    if(rows!=status)
+        memcpy(status, rows, maxDevices*8);
+    if(held)
+        return;
+    for(int row=0;row<8;row++) {
+        for(int addr=0;addr<maxDevices;addr++)
+            data[addr]=status[addr*8+row];
+        spiTransferChain(row+1, data);
+    }
+}
+
+void LedControl::hold(bool h) {
+    held=h;
+}
+
+void LedControl::showRow(int row, const byte *values) {
+    if(row<0 || row>7)
+        return;
+    spiTransferChain(row+1, values);
 }
 
 void LedControl::backup() {
   memcpy(backupStatus, status, 64);
 }
 void LedControl::restore() {
-  memcpy(status, backupStatus, 64);
-  int offset;
-  for (int addr=0; addr<maxDevices; addr++) {
-    offset=addr*8;
-    for(int i=0;i<8;i++) {
-      spiTransfer(addr, i+1,status[offset+i]);
-    }
-  }
+  setAll(backupStatus);
 }
@@ -0,0 +1,98 @@
+#include "Log.h"
+#include "Protocol.h"
+
+#define LOG_MASK (LOG_BUFFER - 1)
+
+Logger logger;
+
+Logger::Logger()
+{
+    head = 0;
+    tail = 0;
+    lost = 0;
+}
+
+// In de ringbuffer staat voor elk record de lengte, zodat drain() hele records doorzet
+void Logger::header(byte id, byte size)
+{
+    buffer[head] = size - 1;
+    head = (head + 1) & LOG_MASK;
+    buffer[head] = id;
+    head = (head + 1) & LOG_MASK;
+    put(millis());
+}
+
+// Reserveer ruimte voor een record van size bytes en schrijf de kop.
+// Past het niet, dan wordt het bericht geteld en weggegooid.
+bool Logger::begin(byte id, byte size)
+{
+    byte used = (head - tail) & LOG_MASK;
+
+    // Houd altijd 6 bytes over om het verlies zelf te melden
+    if (used + size + 6 >= LOG_BUFFER)
+    {
+        lost += size;
+        return false;
+    }
+    if (lost > 0)
+    {
+        header(LOG_DROPPED, 6);
+        put(lost);
+        lost = 0;
+    }
+    header(id, size);
+    return true;
+}
+
+void Logger::put(unsigned int value)
+{
+    buffer[head] = value & 0xFF;
+    head = (head + 1) & LOG_MASK;
+    buffer[head] = value >> 8;
+    head = (head + 1) & LOG_MASK;
+}
+
+void Logger::event(byte id)
+{
+    begin(id, 4);
+}
+
+void Logger::event(byte id, int a)
+{
+    if (begin(id, 6))
+        put(a);
+}
+
+void Logger::event(byte id, int a, int b)
+{
+    if (begin(id, 8))
+    {
+        put(a);
+        put(b);
+    }
+}
+
+void Logger::drain()
+{
+    byte record[LOG_RECORD_MAX];
+
+    while (tail != head)
+    {
+        byte length = buffer[tail];
+        for (byte i = 0; i < length; i++)
+            record[i] = buffer[(tail + 1 + i) & LOG_MASK];
+        if (!protocol.send(FRAME_LOG, record, length))
+            return;
+        tail = (tail + 1 + length) & LOG_MASK;
+    }
+}
+
+void Logger::flush()
+{
+    while (tail != head)
+    {
+        drain();
+        protocol.flush();
+    }
+    protocol.flush();
+}
@@ -0,0 +1,83 @@
+#include "Margolus.h"
+
+// Een blok met linksboven cel (x,y) heeft vier cellen, van hoog naar laag:
+//   bit 0: (x+1, y)     boven
+//   bit 1: (x,   y)     midden links
+//   bit 2: (x+1, y+1)   midden rechts
+//   bit 3: (x,   y+1)   onder
+// Elke korrel zakt naar de laagste vrije plek in het blok. Waar een korrel
+// links of rechts kan uitwijken geeft de tweede tabel de andere keuze.
+const byte margolusRules[2][16] PROGMEM = {
+    {0, 8, 8, 10, 8, 12, 12, 14, 8, 10, 10, 14, 12, 14, 14, 15},
+    {0, 8, 8, 12, 8, 10, 10, 14, 8, 12, 10, 14, 12, 14, 14, 15},
+};
+
+Margolus::Margolus()
+{
+    phase = 0;
+    seed = 1;
+}
+
+void Margolus::setSeed(unsigned int s)
+{
+    seed = s ? s : 1;
+    phase = 0;
+}
+
+// xorshift, veel goedkoper dan random() voor een bit per blok
+byte Margolus::nextRandom()
+{
+    seed ^= seed << 7;
+    seed ^= seed >> 9;
+    seed ^= seed << 8;
+    return seed;
+}
+
+// Een rij met de cellen buiten het bord erbij: bit x+1 is cel x. Links (x = -1)
+// en onder (y = 8) is een wand, daar ligt het zand tegenaan; boven (y = -1) en
+// rechts (x = 8) is lucht. Zo hebben ook de randcellen met verschuiving 1 een blok.
+static unsigned int extendRow(byte rows[8], int y)
+{
+    if (y < 0)
+        return 0;
+    if (y > 7)
+        return 0x3FF;
+    return (rows[y] << 1) | 1;
+}
+
+bool Margolus::step(byte rows[8])
+{
+    bool somethingMoved = false;
+
+    for (int y = -phase; y < 7 + phase; y += 2)
+    {
+        unsigned int top = extendRow(rows, y);
+        unsigned int bottom = extendRow(rows, y + 1);
+        byte coin = nextRandom();
+        for (int x = -phase; x < 7 + phase; x += 2)
+        {
+            byte block = ((top >> (x + 2)) & 1) |
+                         (((top >> (x + 1)) & 1) << 1) |
+                         (((bottom >> (x + 2)) & 1) << 2) |
+                         (((bottom >> (x + 1)) & 1) << 3);
+            byte next = pgm_read_byte_near(&margolusRules[coin & 1][block]);
+            coin >>= 1;
+
+            unsigned int mask = ~(3U << (x + 1));
+            top = (top & mask) | ((next & 1) << (x + 2)) | (((next >> 1) & 1) << (x + 1));
+            bottom = (bottom & mask) | (((next >> 2) & 1) << (x + 2)) | (((next >> 3) & 1) << (x + 1));
+            somethingMoved |= (next != block);
+        }
+        // De regels verplaatsen nooit iets in een wand of in de lucht erboven
+        if (y >= 0)
+            rows[y] = top >> 1;
+        if (y + 1 <= 7)
+            rows[y + 1] = bottom >> 1;
+    }
+    return somethingMoved;
+}
+
+void Margolus::nextPhase()
+{
+    phase ^= 1;
+}
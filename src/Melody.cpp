@@ -0,0 +1,42 @@
+#include "Melody.h"
+
+Melody::Melody()
+{
+    count = 0;
+    index = 0;
+}
+
+void Melody::begin(byte p)
+{
+    pin = p;
+}
+
+void Melody::play(const note *n, byte c)
+{
+    notes = n;
+    count = c;
+    index = 0;
+    nextNote = millis();
+    service();
+}
+
+void Melody::service()
+{
+    note current;
+
+    if (!playing() || (long)(millis() - nextNote) < 0)
+        return;
+    memcpy_P(&current, &notes[index++], sizeof(note));
+    tone(pin, current.frequency, current.duration);
+    nextNote += current.next;
+}
+
+bool Melody::playing()
+{
+    return index < count;
+}
+
+unsigned long Melody::deadline()
+{
+    return nextNote;
+}
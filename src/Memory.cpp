@@ -0,0 +1,59 @@
+#include "Memory.h"
+
+extern char __heap_start;
+extern char *__brkval;
+
+#define MEMORY_STR(x) #x
+#define MEMORY_XSTR(x) MEMORY_STR(x)
+
+// Draait in .init3: de stack staat al goed en r1 is nul, maar .data, .bss en de
+// constructors zijn nog niet geweest. Alles boven __heap_start is dan vrij.
+// Een naked functie mag alleen basic asm bevatten: geen locals, geen prologue,
+// en geen ret, want de code loopt door in .init4.
+void memoryPaint() __attribute__((naked, used, section(".init3")));
+void memoryPaint()
+{
+    asm volatile(
+        "    ldi r30, lo8(__heap_start)\n"
+        "    ldi r31, hi8(__heap_start)\n"
+        "    in r26, __SP_L__\n"
+        "    in r27, __SP_H__\n"
+        "    ldi r24, " MEMORY_XSTR(MEMORY_CANARY) "\n"
+        // Tot aan SP, die naar de eerste vrije byte van de stack wijst
+        "1:  cp r30, r26\n"
+        "    cpc r31, r27\n"
+        "    brsh 2f\n"
+        "    st Z+, r24\n"
+        "    rjmp 1b\n"
+        "2:\n");
+}
+
+static char *heapEnd()
+{
+    return __brkval ? __brkval : &__heap_start;
+}
+
+int memoryFree()
+{
+    return (char *)SP - heapEnd();
+}
+
+int memoryHeadroom()
+{
+    char *p = heapEnd();
+    int n = 0;
+
+    while (p + n <= (char *)RAMEND && p[n] == MEMORY_CANARY)
+        n++;
+    return n;
+}
+
+int memoryStackUsed()
+{
+    return (char *)RAMEND - heapEnd() - memoryHeadroom() + 1;
+}
+
+bool memoryGuardBreached()
+{
+    return memoryHeadroom() < MEMORY_GUARD;
+}
@@ -0,0 +1,173 @@
+#include "Neck.h"
+
+// De hals ligt fysiek tussen pixel (0,0) van matrix A en pixel (7,7) van matrix B.
+// Per richting (0, 90, 180, 270 graden) staan hier dezelfde twee pixels in logische
+// coordinaten, uitgaande van ROTATION_OFFSET 90. Matrix A = 0, matrix B = 1.
+const static neckCells neckTable[4] PROGMEM = {
+    {0, 0, 7, 1, 7, 0}, // 0: van het laagste punt van A naar het hoogste punt van B
+    {0, 7, 7, 1, 0, 0}, // 90: zijwaarts, van A naar B op halve hoogte
+    {1, 0, 7, 0, 7, 0}, // 180: van het laagste punt van B naar het hoogste punt van A
+    {1, 7, 7, 0, 0, 0}, // 270: zijwaarts, van B naar A op halve hoogte
+};
+
+bool Neck::getCells(int gravity, neckCells &cells)
+{
+    if (gravity < 0 || gravity % 90 != 0 || gravity >= 360)
+        return false;
+    if (!NECK_SIDEWAYS && (gravity == 90 || gravity == 270))
+        return false;
+    memcpy_P(&cells, &neckTable[gravity / 90], sizeof(neckCells));
+    return true;
+}
+
+// De tijd voor korrel i, langer als de doorstroming minder is
+unsigned long Neck::step(byte i)
+{
+    if (flow == NECK_FLOW_FULL)
+        return steps[i];
+    return ((unsigned long)steps[i] * scale) >> 8;
+}
+
+void Neck::start(const unsigned int *table, byte n, byte first, unsigned long firstDelay)
+{
+    steps = table;
+    count = n;
+    index = first;
+    flow = NECK_FLOW_FULL;
+    scale = 256;
+    nextDrop = millis() + firstDelay;
+}
+
+void Neck::resume(unsigned long firstDelay)
+{
+    nextDrop = millis() + firstDelay;
+}
+
+byte Neck::position()
+{
+    return index;
+}
+
+bool Neck::finished()
+{
+    return index >= count;
+}
+
+unsigned long Neck::timeFor(byte grains)
+{
+    long first = nextDrop - millis();
+    unsigned long total = first > 0 ? first : 0;
+
+    if (grains == 0 || finished())
+        return 0;
+    for (byte i = index + 1; i < count && i < index + grains; i++)
+        total += step(i);
+    return total;
+}
+
+void Neck::setFlow(byte f)
+{
+    if (f == 0)
+        f = 1;
+    if (f == flow)
+        return;
+    flow = f;
+    // Een deling alleen als de doorstroming verandert, niet per korrel
+    scale = (256UL * NECK_FLOW_FULL) / flow;
+}
+
+byte Neck::owed()
+{
+    unsigned long now = millis();
+    unsigned long deadline = nextDrop;
+    byte behind = 0;
+
+    // Loop de tabel af in plaats van te delen; hooguit NECK_MAX_BURST stappen
+    for (byte i = index; i < count && behind < NECK_MAX_BURST && (long)(now - deadline) >= 0; i++)
+    {
+        behind++;
+        if (i + 1 < count)
+            deadline += step(i + 1);
+    }
+    return behind;
+}
+
+byte Neck::due(int gravity)
+{
+    neckCells cells;
+    byte count = owed();
+
+    if (count > 0 && !getCells(gravity, cells))
+    {
+        // Geen hals in deze richting: pauzeer zonder achterstand op te bouwen
+        skip();
+        return 0;
+    }
+    return count;
+}
+
+bool Neck::transfer(LedControl &lc, int gravity)
+{
+    neckCells cells;
+
+    if (finished() || !getCells(gravity, cells))
+        return false;
+    if (!lc.getXY(cells.from, cells.fromX, cells.fromY) || lc.getXY(cells.to, cells.toX, cells.toY))
+        return false;
+    lc.setXY(cells.from, cells.fromX, cells.fromY, false);
+    lc.setXY(cells.to, cells.toX, cells.toY, true);
+    advance();
+    return true;
+}
+
+void Neck::advance()
+{
+    if (finished())
+        return;
+    if (++index < count)
+        nextDrop += step(index);
+}
+
+void Neck::skip()
+{
+    if (!finished())
+        nextDrop = millis() + step(index);
+}
+
+unsigned long Neck::deadline()
+{
+    return nextDrop;
+}
+
+int Neck::destination(int gravity)
+{
+    neckCells cells;
+
+    if (!getCells(gravity, cells))
+        return -1;
+    return cells.to;
+}
+
+int Neck::source(int gravity)
+{
+    neckCells cells;
+
+    if (!getCells(gravity, cells))
+        return -1;
+    return cells.from;
+}
+
+coord Neck::entry(int gravity)
+{
+    neckCells cells;
+    coord xy;
+
+    xy.x = -1;
+    xy.y = -1;
+    if (getCells(gravity, cells))
+    {
+        xy.x = cells.toX;
+        xy.y = cells.toY;
+    }
+    return xy;
+}
@@ -0,0 +1,199 @@
+#include "Particles.h"
+#include "Profile.h"
+
+#define CELL(v) ((v) >> 8)
+#define MATRIX_OF(x, y) (((x) >= 8 && (y) >= 8) ? 0 : (((x) < 8 && (y) < 8) ? 1 : -1))
+
+void Particles::load(LedControl &lc)
+{
+    count = 0;
+    crossings = 0;
+    frame = 0;
+    maxMicros = 0;
+    for (byte addr = 0; addr < 2; addr++)
+    {
+        byte offset = (addr == 0) ? 8 : 0;
+        for (byte y = 0; y < 8; y++)
+        {
+            occupied[addr][y] = 0;
+            for (byte x = 0; x < 8; x++)
+            {
+                if (!lc.getRawXY(addr, x, y) || count >= PARTICLE_MAX)
+                    continue;
+                setOccupied(x + offset, y + offset, true);
+                grain &g = grains[count++];
+                g.x = ((x + offset) << 8) | 0x80;
+                g.y = ((y + offset) << 8) | 0x80;
+                g.vx = 0;
+                g.vy = 0;
+            }
+        }
+    }
+}
+
+bool Particles::isFree(int x, int y)
+{
+    int addr = MATRIX_OF(x, y);
+
+    if (x < 0 || y < 0 || x > 15 || y > 15 || addr == -1)
+        return false;
+    return !((occupied[addr][y & 7] >> (7 - (x & 7))) & 1);
+}
+
+void Particles::setOccupied(int x, int y, bool state)
+{
+    int addr = MATRIX_OF(x, y);
+    byte bit = 0x80 >> (x & 7);
+
+    if (state)
+        occupied[addr][y & 7] |= bit;
+    else
+        occupied[addr][y & 7] &= ~bit;
+}
+
+// Probeer een korrel naar (nx, ny) te verplaatsen. Een botsing zet de snelheid
+// langs die as op nul en laat de korrel tegen de rand van zijn cel liggen.
+bool Particles::tryMove(grain &g, int nx, int ny, byte &budget)
+{
+    int cx = CELL(g.x);
+    int cy = CELL(g.y);
+    int ncx = CELL(nx);
+    int ncy = CELL(ny);
+
+    if (ncx == cx && ncy == cy)
+    {
+        g.x = nx;
+        g.y = ny;
+        return true;
+    }
+    if (isFree(ncx, ncy))
+    {
+        // Van de ene naar de andere matrix kan alleen diagonaal door de hals
+        bool crossing = MATRIX_OF(cx, cy) != MATRIX_OF(ncx, ncy);
+        if (!crossing || budget > 0)
+        {
+            if (crossing)
+            {
+                budget--;
+                crossings++;
+            }
+            setOccupied(cx, cy, false);
+            setOccupied(ncx, ncy, true);
+            g.x = nx;
+            g.y = ny;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Op zijn zij staat de zwaartekracht dwars op de hals en duwt niets erdoorheen.
+// Een korrel die vastligt in de hals loopt dan over naar de andere kant als daar
+// plaats is: zand dat tot boven de hals reikt, stroomt over, zoals bij echt zand.
+bool Particles::spill(grain &g, byte &budget)
+{
+    int cx = CELL(g.x);
+    int cy = CELL(g.y);
+    int other;
+
+    if (cx == 7 && cy == 7)
+        other = 8;
+    else if (cx == 8 && cy == 8)
+        other = 7;
+    else
+        return false;
+    return tryMove(g, (other << 8) | 0x80, (other << 8) | 0x80, budget);
+}
+
+bool Particles::step(int gx, int gy, byte budget)
+{
+    unsigned long start = micros();
+    int ax = (gx * PARTICLE_GAIN) >> 6;
+    int ay = (gy * PARTICLE_GAIN) >> 6;
+    bool somethingMoved = false;
+    // De hals ligt langs (1,1): meer zwaartekracht dwars daarop dan erlangs is op zijn zij
+    bool sideways = abs(gx + gy) < abs(gx - gy);
+
+    crossings = 0;
+    frame++;
+    for (byte i = 0; i < count; i++)
+    {
+        grain &g = grains[i];
+        int x = g.x;
+        int y = g.y;
+
+        g.vx = constrain(g.vx + ax - (g.vx >> PARTICLE_DAMPING), -PARTICLE_VMAX, PARTICLE_VMAX);
+        g.vy = constrain(g.vy + ay - (g.vy >> PARTICLE_DAMPING), -PARTICLE_VMAX, PARTICLE_VMAX);
+
+        if (!tryMove(g, g.x + g.vx, g.y + g.vy, budget))
+        {
+            // Glijden langs een as, om het frame de andere as eerst
+            int edgeX = g.vx > 0 ? (g.x | 0xFF) : (g.vx < 0 ? (g.x & ~0xFF) : g.x);
+            int edgeY = g.vy > 0 ? (g.y | 0xFF) : (g.vy < 0 ? (g.y & ~0xFF) : g.y);
+            bool xFirst = frame & 1;
+
+            if (tryMove(g, xFirst ? g.x + g.vx : edgeX, xFirst ? edgeY : g.y + g.vy, budget))
+            {
+                if (xFirst)
+                    g.vy = 0;
+                else
+                    g.vx = 0;
+            }
+            else if (tryMove(g, xFirst ? edgeX : g.x + g.vx, xFirst ? g.y + g.vy : edgeY, budget))
+            {
+                if (xFirst)
+                    g.vx = 0;
+                else
+                    g.vy = 0;
+            }
+            else if (sideways && spill(g, budget))
+            {
+                g.vx = 0;
+                g.vy = 0;
+            }
+            else
+            {
+                g.x = edgeX;
+                g.y = edgeY;
+                g.vx = 0;
+                g.vy = 0;
+            }
+        }
+        if (CELL(x) != CELL(g.x) || CELL(y) != CELL(g.y))
+        {
+            somethingMoved = true;
+            PROFILE_COUNT(grainsMoved, 1);
+        }
+    }
+    lastMicros = micros() - start;
+    if (lastMicros > maxMicros)
+        maxMicros = lastMicros;
+    return somethingMoved;
+}
+
+void Particles::render(LedControl &lc)
+{
+    for (byte addr = 0; addr < 2; addr++)
+    {
+        for (byte y = 0; y < 8; y++)
+        {
+            if (lc.getRow(addr, y) != occupied[addr][y])
+                lc.setRow(addr, y, occupied[addr][y]);
+        }
+    }
+}
+
+byte Particles::crossed()
+{
+    return crossings;
+}
+
+unsigned long Particles::frameMicros()
+{
+    return lastMicros;
+}
+
+unsigned long Particles::peakMicros()
+{
+    return maxMicros;
+}
@@ -0,0 +1,87 @@
+#include "Persist.h"
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <util/crc16.h>
+
+#define SLOT_ADDRESS(n) ((byte *)(PERSIST_BASE + (n) * PERSIST_SLOT_SIZE))
+
+#ifdef __AVR__
+static_assert(sizeof(persistRecord) <= PERSIST_SLOT_SIZE, "persistRecord past niet in een plaats");
+#endif
+
+Persist::Persist()
+{
+    slot = 0;
+    writing = false;
+    sequence = 0;
+    lastCheckpoint = 0;
+}
+
+uint16_t Persist::crc(const persistRecord &r)
+{
+    const byte *p = (const byte *)&r;
+    uint16_t c = 0xFFFF;
+
+    // Tot de CRC zelf; op de host volgt daar nog opvulling
+    for (byte i = 0; i < offsetof(persistRecord, crc); i++)
+        c = _crc16_update(c, p[i]);
+    return c;
+}
+
+bool Persist::load(persistRecord &r)
+{
+    persistRecord candidate;
+    bool found = false;
+
+    for (byte n = 0; n < PERSIST_SLOTS; n++)
+    {
+        eeprom_read_block(&candidate, SLOT_ADDRESS(n), sizeof(persistRecord));
+        if (candidate.version != PERSIST_VERSION || candidate.crc != crc(candidate))
+            continue;
+        // Vergelijk volgnummers zo dat ook een overloop van de teller goed gaat
+        if (found && (int)(candidate.sequence - r.sequence) <= 0)
+            continue;
+        memcpy(&r, &candidate, sizeof(persistRecord));
+        slot = n;
+        found = true;
+    }
+    if (found)
+        sequence = r.sequence;
+    return found;
+}
+
+bool Persist::ready(bool force)
+{
+    return !writing && (force || millis() - lastCheckpoint >= PERSIST_INTERVAL);
+}
+
+void Persist::checkpoint(const persistRecord &r)
+{
+    memcpy(&pending, &r, sizeof(persistRecord));
+    pending.sequence = ++sequence;
+    pending.version = PERSIST_VERSION;
+    pending.crc = crc(pending);
+    slot = (slot + 1) % PERSIST_SLOTS;
+    written = 0;
+    writing = true;
+    lastCheckpoint = millis();
+}
+
+void Persist::service()
+{
+    const byte *p = (const byte *)&pending;
+
+    // eeprom_update_byte slaat ongewijzigde bytes over zonder te wachten,
+    // een echte schrijfactie duurt ongeveer 3,4 ms en gebeurt in de achtergrond
+    while (writing && eeprom_is_ready())
+    {
+        eeprom_update_byte(SLOT_ADDRESS(slot) + written, p[written]);
+        if (++written == sizeof(persistRecord))
+            writing = false;
+    }
+}
+
+bool Persist::busy()
+{
+    return writing;
+}
@@ -0,0 +1,86 @@
+#include "Power.h"
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+static byte wakePin;
+
+// De watchdog heeft de processor gewekt, niet de knop
+static volatile bool watchdogWoke;
+
+ISR(WDT_vect)
+{
+    watchdogWoke = true;
+}
+
+// Een LOW-niveau interrupt blijft afgaan zolang de knop is ingedrukt
+static void wakeUp()
+{
+    detachInterrupt(digitalPinToInterrupt(wakePin));
+}
+
+void PowerManager::begin(byte buttonPin)
+{
+    wakePin = buttonPin;
+    resetStats();
+}
+
+void PowerManager::idle(unsigned long ms)
+{
+    unsigned long start = micros();
+    unsigned long t = ms * 1000;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (micros() - start < t)
+        sleep_mode();
+    idleMicros += micros() - start;
+}
+
+void PowerManager::powerDown()
+{
+    byte adc = ADCSRA;
+
+    // De ADC gebruikt in power-down nog stroom
+    ADCSRA &= ~_BV(ADEN);
+    attachInterrupt(digitalPinToInterrupt(wakePin), wakeUp, LOW);
+
+    cli();
+    watchdogWoke = false;
+    wdt_reset();
+    MCUSR &= ~_BV(WDRF);
+    WDTCSR = _BV(WDCE) | _BV(WDE);
+    WDTCSR = _BV(WDIE) | _BV(WDP2); // alleen interrupt, na 0,25 seconde
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    wdt_disable();
+    detachInterrupt(digitalPinToInterrupt(wakePin));
+    ADCSRA = adc;
+    // millis() staat stil in power-down, dus tellen we de watchdog-periode. Wekt
+    // de knop de processor eerder, dan is onbekend hoe lang hij sliep: niet tellen.
+    if (watchdogWoke)
+        downMillis += POWER_WDT_PERIOD;
+}
+
+void PowerManager::resetStats()
+{
+    statsStart = millis();
+    idleMicros = 0;
+    downMillis = 0;
+}
+
+unsigned long PowerManager::sleptMillis()
+{
+    return idleMicros / 1000 + downMillis;
+}
+
+byte PowerManager::dutyCycle()
+{
+    unsigned long total = millis() - statsStart + downMillis;
+
+    if (total == 0)
+        return 100;
+    return 100 - (sleptMillis() * 100) / total;
+}
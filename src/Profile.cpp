@@ -0,0 +1,112 @@
+#include "Profile.h"
+#include "Memory.h"
+
+#ifdef ZANDLOPER_PROFILE
+
+Profile profile;
+
+// Namen en tabel in flash: SRAM is te krap voor teksten die alleen dump() gebruikt
+const static char nameGravity[] PROGMEM = "getGravity";
+const static char nameUpdate[] PROGMEM = "updateMatrix";
+const static char nameDrop[] PROGMEM = "dropParticles";
+const static char nameDisplay[] PROGMEM = "display";
+const static char nameCount[] PROGMEM = "countParticles";
+const static char nameProtocol[] PROGMEM = "protocol";
+const static char *const timerNames[PROF_TIMERS] PROGMEM = {
+    nameGravity, nameUpdate, nameDrop, nameDisplay, nameCount, nameProtocol};
+
+void Profile::reset()
+{
+    memset(&data, 0, sizeof(data));
+    for (byte i = 0; i < PROF_TIMERS; i++)
+        data.timers[i].min = 0xFFFF;
+    data.loop.min = 0xFFFF;
+}
+
+void Profile::add(profileTimerStats &stats, unsigned long t)
+{
+    if (t > 0xFFFF)
+        t = 0xFFFF;
+    stats.total += t;
+    stats.calls++;
+    if (t < stats.min)
+        stats.min = t;
+    if (t > stats.max)
+        stats.max = t;
+}
+
+void Profile::stop(byte timer, unsigned long start)
+{
+    add(data.timers[timer], micros() - start);
+}
+
+void Profile::frame(unsigned long start)
+{
+    unsigned long t = micros() - start;
+    byte bucket = 0;
+
+    add(data.loop, t);
+    while (t > 0 && bucket < PROFILE_BUCKETS - 1)
+    {
+        t >>= 1;
+        bucket++;
+    }
+    data.histogram[bucket]++;
+}
+
+static void dumpStats(const __FlashStringHelper *name, profileTimerStats &stats)
+{
+    Serial.print(name);
+    Serial.print(F(": n="));
+    Serial.print(stats.calls);
+    if (stats.calls == 0)
+    {
+        Serial.println();
+        return;
+    }
+    Serial.print(F(" min="));
+    Serial.print(stats.min);
+    Serial.print(F(" avg="));
+    Serial.print(stats.total / stats.calls);
+    Serial.print(F(" max="));
+    Serial.print(stats.max);
+    Serial.println(F(" us"));
+}
+
+void Profile::dump()
+{
+    for (byte i = 0; i < PROF_TIMERS; i++)
+        dumpStats((const __FlashStringHelper *)pgm_read_ptr(&timerNames[i]), data.timers[i]);
+    dumpStats(F("loop"), data.loop);
+    Serial.print(F("spi: "));
+    Serial.print(data.spiTransfers);
+    Serial.print(F(" transfers, "));
+    Serial.print(data.spiBytes);
+    Serial.println(F(" bytes"));
+    Serial.print(F("grains moved: "));
+    Serial.print(data.grainsMoved);
+    Serial.print(F(" drops: "));
+    Serial.print(data.drops);
+    Serial.print(F(" deadline misses: "));
+    Serial.println(data.deadlineMisses);
+    Serial.print(F("first frame: "));
+    Serial.print(firstFrame);
+    Serial.println(F(" us"));
+    Serial.print(F("sram free: "));
+    Serial.print(memoryFree());
+    Serial.print(F(" headroom: "));
+    Serial.print(memoryHeadroom());
+    Serial.print(F(" stack: "));
+    Serial.println(memoryStackUsed());
+    for (byte i = 0; i < PROFILE_BUCKETS; i++)
+    {
+        if (data.histogram[i] == 0)
+            continue;
+        Serial.print(F("< "));
+        Serial.print(1UL << i);
+        Serial.print(F(" us: "));
+        Serial.println(data.histogram[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "Protocol.h"
+#include <util/crc16.h>
+
+#define TX_MASK (PROTOCOL_TX_BUFFER - 1)
+
+enum rxStates {
+    RX_SYNC,
+    RX_TYPE,
+    RX_LENGTH,
+    RX_PAYLOAD,
+    RX_CRC
+};
+
+Protocol protocol;
+
+Protocol::Protocol()
+{
+    txHead = 0;
+    txTail = 0;
+    rxState = RX_SYNC;
+    dropped = 0;
+}
+
+void Protocol::begin()
+{
+    Serial.begin(PROTOCOL_BAUD);
+}
+
+void Protocol::push(byte b)
+{
+    tx[txHead] = b;
+    txHead = (txHead + 1) & TX_MASK;
+}
+
+bool Protocol::send(byte type, const byte *payload, byte length)
+{
+    byte used = (txHead - txTail) & TX_MASK;
+
+    if (length > PROTOCOL_MAX_PAYLOAD || used + length + 4 >= PROTOCOL_TX_BUFFER)
+    {
+        dropped++;
+        return false;
+    }
+    byte crc = _crc8_ccitt_update(0, type);
+    crc = _crc8_ccitt_update(crc, length);
+    push(PROTOCOL_SYNC);
+    push(type);
+    push(length);
+    for (byte i = 0; i < length; i++)
+    {
+        push(payload[i]);
+        crc = _crc8_ccitt_update(crc, payload[i]);
+    }
+    push(crc);
+    return true;
+}
+
+bool Protocol::receive(protocolFrame &frame)
+{
+    while (Serial.available() > 0)
+    {
+        byte b = Serial.read();
+        switch (rxState)
+        {
+        case RX_SYNC:
+            if (b == PROTOCOL_SYNC)
+                rxState = RX_TYPE;
+            break;
+        case RX_TYPE:
+            rx.type = b;
+            rxCrc = _crc8_ccitt_update(0, b);
+            rxState = RX_LENGTH;
+            break;
+        case RX_LENGTH:
+            rx.length = b;
+            rxCrc = _crc8_ccitt_update(rxCrc, b);
+            rxPos = 0;
+            if (b > PROTOCOL_MAX_PAYLOAD)
+                rxState = RX_SYNC;
+            else
+                rxState = (b == 0) ? RX_CRC : RX_PAYLOAD;
+            break;
+        case RX_PAYLOAD:
+            rx.payload[rxPos++] = b;
+            rxCrc = _crc8_ccitt_update(rxCrc, b);
+            if (rxPos == rx.length)
+                rxState = RX_CRC;
+            break;
+        case RX_CRC:
+            rxState = RX_SYNC;
+            if (b == rxCrc)
+            {
+                memcpy(&frame, &rx, sizeof(protocolFrame));
+                return true;
+            }
+            break;
+        }
+    }
+    return false;
+}
+
+void Protocol::service()
+{
+    int room = Serial.availableForWrite();
+
+    while (room-- > 0 && txTail != txHead)
+    {
+        Serial.write(tx[txTail]);
+        txTail = (txTail + 1) & TX_MASK;
+    }
+}
+
+void Protocol::flush()
+{
+    while (txTail != txHead)
+    {
+        Serial.write(tx[txTail]);
+        txTail = (txTail + 1) & TX_MASK;
+    }
+    Serial.flush();
+}
+
+unsigned int Protocol::droppedFrames()
+{
+    return dropped;
+}
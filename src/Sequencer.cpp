@@ -0,0 +1,184 @@
+#include "Sequencer.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+// 2^24 / n, afgerond, voor n = 1..SEQUENCER_MAX_GRAINS: k / n is dan (k * reciprocal[n - 1]) >> 8 in Q16
+const static uint32_t reciprocal[SEQUENCER_MAX_GRAINS] PROGMEM = {
+    16777216UL, 8388608UL, 5592405UL, 4194304UL, 3355443UL, 2796203UL,
+    2396745UL, 2097152UL, 1864135UL, 1677722UL, 1525201UL, 1398101UL,
+    1290555UL, 1198373UL, 1118481UL, 1048576UL, 986895UL, 932068UL,
+    883011UL, 838861UL, 798915UL, 762601UL, 729444UL, 699051UL,
+    671089UL, 645278UL, 621378UL, 599186UL, 578525UL, 559241UL,
+    541201UL, 524288UL, 508400UL, 493448UL, 479349UL, 466034UL,
+    453438UL, 441506UL, 430185UL, 419430UL, 409200UL, 399458UL,
+    390168UL, 381300UL, 372827UL, 364722UL, 356962UL, 349525UL,
+    342392UL, 335544UL, 328965UL, 322639UL, 316551UL, 310689UL,
+    305040UL, 299593UL, 294337UL, 289262UL, 284360UL, 279620UL,
+};
+
+// Het programma en daarachter de CRC
+#define PROGRAM_CRC (SEQUENCER_EEPROM_BASE + sizeof(program))
+
+#ifdef __AVR__
+static_assert(sizeof(segment) == 4, "segment moet 4 bytes zijn, zoals in CMD_PROGRAM");
+static_assert(PROGRAM_CRC < E2END + 1, "het programma past niet in het EEPROM");
+#endif
+
+const segment &Sequencer::active()
+{
+    return current.segments[part];
+}
+
+/*
+ * De tijd van korrel k (1..n) in miliseconden sinds het begin van het segment:
+ * seconds * f(k / n), met f de vorm van het segment, alles in Q16.
+ */
+static unsigned long grainTime(const segment &s, unsigned long recip, byte k)
+{
+    if (k == s.grains)
+        return s.seconds * 1000UL;
+
+    unsigned long p = (k * recip) >> 8;
+    unsigned long f;
+
+    switch (s.shape & FLOW_MASK)
+    {
+    case FLOW_FAST_START:
+        f = (p * p) >> 16;
+        break;
+    case FLOW_SLOW_START:
+        f = 65536UL - (((65536UL - p) * (65536UL - p)) >> 16);
+        break;
+    default:
+        f = p;
+        break;
+    }
+    // seconds * 1000 * f / 65536 zonder overloop: eerst de hele seconden, dan de rest
+    unsigned long product = s.seconds * f;
+    return (product >> 16) * 1000UL + (((product & 0xFFFF) * 1000UL) >> 16);
+}
+
+/* Reken het actieve segment om naar de tabel: per korrel de tijd sinds de vorige. */
+void Sequencer::compile()
+{
+    const segment &s = active();
+    unsigned long recip = pgm_read_dword(&reciprocal[s.grains - 1]);
+    unsigned long previous = 0;
+
+    for (byte k = 1; k <= s.grains; k++)
+    {
+        unsigned long time = grainTime(s, recip, k);
+        steps[k - 1] = time - previous;
+        previous = time;
+    }
+}
+
+void Sequencer::begin(const program &p, byte at)
+{
+    memcpy(&current, &p, sizeof(program));
+    position = at < p.repeat * p.count ? at : 0;
+    part = position;
+    while (part >= current.count)
+        part -= current.count;
+    compile();
+}
+
+void Sequencer::begin(unsigned int seconds, byte grains)
+{
+    current.repeat = 1;
+    current.count = 1;
+    current.segments[0].seconds = seconds;
+    current.segments[0].grains = grains;
+    current.segments[0].shape = FLOW_EVEN | CUE_NONE;
+    position = 0;
+    part = 0;
+    compile();
+}
+
+bool Sequencer::next()
+{
+    if (last())
+        return false;
+    position++;
+    if (++part == current.count)
+        part = 0;
+    compile();
+    return true;
+}
+
+bool Sequencer::last()
+{
+    return position + 1 >= current.repeat * current.count;
+}
+
+byte Sequencer::index()
+{
+    return position;
+}
+
+byte Sequencer::cue()
+{
+    return active().shape & CUE_MASK;
+}
+
+unsigned int Sequencer::seconds()
+{
+    return active().seconds;
+}
+
+const unsigned int *Sequencer::table()
+{
+    return steps;
+}
+
+byte Sequencer::grains()
+{
+    return active().grains;
+}
+
+bool Sequencer::valid(const program &p)
+{
+    if (p.count == 0 || p.count > SEQUENCER_MAX_SEGMENTS || p.repeat == 0 || p.repeat * p.count > 255)
+        return false;
+    for (byte i = 0; i < p.count; i++)
+    {
+        const segment &s = p.segments[i];
+        if (s.grains == 0 || s.grains > SEQUENCER_MAX_GRAINS || s.seconds == 0)
+            return false;
+        if ((s.shape & FLOW_MASK) > FLOW_SLOW_START || (s.shape & CUE_MASK) > CUE_REFILL)
+            return false;
+        // Elke stap moet in de tabel passen; precies zoals compile() ze uitrekent
+        unsigned long recip = pgm_read_dword(&reciprocal[s.grains - 1]);
+        unsigned long previous = 0;
+        for (byte k = 1; k <= s.grains; k++)
+        {
+            unsigned long time = grainTime(s, recip, k);
+            if (time - previous > 65535UL)
+                return false;
+            previous = time;
+        }
+    }
+    return true;
+}
+
+static byte programCrc(const program &p)
+{
+    const byte *b = (const byte *)&p;
+    byte c = 0;
+
+    for (byte i = 0; i < sizeof(program); i++)
+        c = _crc8_ccitt_update(c, b[i]);
+    return c;
+}
+
+bool Sequencer::read(program &p)
+{
+    eeprom_read_block(&p, (const void *)SEQUENCER_EEPROM_BASE, sizeof(program));
+    return eeprom_read_byte((const byte *)PROGRAM_CRC) == programCrc(p) && valid(p);
+}
+
+void Sequencer::write(const program &p)
+{
+    eeprom_update_block(&p, (void *)SEQUENCER_EEPROM_BASE, sizeof(program));
+    eeprom_update_byte((byte *)PROGRAM_CRC, programCrc(p));
+}
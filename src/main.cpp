@@ -2,13 +2,34 @@
 #include "LedControl.h"
 #include "Delay.h"
 #include "Cijfers.h"
+#include "Neck.h"
+#include "Margolus.h"
+#include "Particles.h"
+#include "FrameRate.h"
+#include "Power.h"
+#include "Profile.h"
+#include "Log.h"
+#include "Protocol.h"
+#include "Memory.h"
+#include "Persist.h"
+#include "Calibration.h"
+#include "Melody.h"
+#include "Compositor.h"
+#include "Animation.h"
+#include "Input.h"
+#include "Capture.h"
+#include "Sequencer.h"
 
 #define MATRIX_A 0
 #define MATRIX_B 1
 
 // Values are 260/330/400
+// Standaardkalibratie zolang er geen gekalibreerde waarden in EEPROM staan
 #define ACC_THRESHOLD_LOW 282
 #define ACC_THRESHOLD_HIGH 348
+// Midden en volle uitslag (1g) van de ADXL335
+#define ACC_CENTER ((ACC_THRESHOLD_LOW + ACC_THRESHOLD_HIGH) / 2)
+#define ACC_FULL_SCALE 70
 
 // Matrix
 #define PIN_DATAIN 5
@@ -25,38 +46,141 @@
 // This takes into account how the matrixes are mounted
 #define ROTATION_OFFSET 90
 
-#define DELAY_FRAME 100
+// Helderheid van de matrices buiten het setupmenu
+#define DISPLAY_INTENSITY 1
 
-#define MODE_HOURGLASS 0
+// Aantal zandkorrels
+#define GRAINS 60
+
+// Zandmotor: de diagonale sweep van updateMatrix(), de Margolus blok-automaat
+// of losse korrels met snelheid langs de gemeten kantelhoek
+#define SAND_ENGINE_SWEEP 0
+#define SAND_ENGINE_MARGOLUS 1
+#define SAND_ENGINE_PARTICLES 2
+#ifndef SAND_ENGINE
+#define SAND_ENGINE SAND_ENGINE_SWEEP
+#endif
 
 #define SETUPEXIT 1000  // 1 seconde button indrukken om setup te verlaten
+#define CALIBRATE_HOLD 4000 // 4 seconden button indrukken in de setup om te kalibreren
+#define CALIBRATE_TIMEOUT 60000UL // zonder bevestiging stopt de kalibratie na een minuut
+
+// Na het omdraaien zoveel miliseconden de resterende tijd over het zand tonen, 0 = uit
+#ifndef OVERLAY_TIME
+#define OVERLAY_TIME 1500
+#endif
 #define BUTTONDELAY 300 // 100 miliseconde per button delay.
 #define BUTTONMARGIN 250
-
-// miliseconde per zandkorrel. Er zijn er 60
-long delaySeconds;
+#define BUTTON_DEBOUNCE 50 // een flank binnen zoveel miliseconden na de vorige is dender
+#define MENU_FRAME 20 // miliseconden per frame in het menu
+#define MENU_WIPE 160 // duur van een overgang in het menu in miliseconden
 
 // De voldende tijden zijn beschikbaar: 30 seconden, 60 seconden, 120 seconden, 300 seconden (5 minuten) en 600 seconden (10 minuten)
 int modes[] = {30, 60, 120, 300, 600};
 int currentMode = 1; //  Start met de eerste mode = 60 sectonden
+#define PLAIN_MODES (sizeof(modes) / sizeof(modes[0]))
+
+// Na de gewone tijden komen de programma's, in het menu P1, P2, ... Daarachter
+// nog een, als er met CMD_PROGRAM een programma in EEPROM is gezet.
+const static program programs[] PROGMEM = {
+    // 5 keer 45 seconden werken en 15 seconden rust, na elk deel omdraaien
+    {5, 2, {{45, GRAINS, FLOW_EVEN | CUE_FLIP}, {15, GRAINS, FLOW_EVEN | CUE_FLIP}}},
+    // 2 minuten met een snel begin en een trage staart
+    {1, 1, {{120, GRAINS, FLOW_FAST_START | CUE_NONE}}},
+    // 4 keer 25 minuten werken en 5 minuten pauze
+    {4, 2, {{1500, GRAINS, FLOW_EVEN | CUE_FLIP}, {300, GRAINS, FLOW_EVEN | CUE_FLIP}}},
+    // 3 keer 40 seconden, het zand ligt daarna vanzelf weer boven
+    {3, 1, {{40, GRAINS, FLOW_EVEN | CUE_REFILL}}},
+};
+#define BUILTIN_PROGRAMS (sizeof(programs) / sizeof(programs[0]))
+static_assert(GRAINS <= SEQUENCER_MAX_GRAINS, "een segment kan niet alle korrels bevatten");
 
-// OBSOLETE int mode = MODE_HOURGLASS;
 int gravity;
-int particlesTop;
-int particlesBottom = 0;
+int lastGravity = -1;
+// Richting die via het protocol is opgelegd, of GRAVITY_AUTO voor de accelerometer
+#define GRAVITY_AUTO -2
+int gravityOverride = GRAVITY_AUTO;
+// Elke zoveel miliseconden een FRAME_STATE versturen, 0 = uit
+unsigned int streamPeriod = 0;
+unsigned long lastStream = 0;
+// Laatst gelezen ruwe waarden van de accelerometer
+int accX;
+int accY;
 
 bool moved = false;
-bool dropped = false;
+byte dropped = 0;
+unsigned int buttonQuiet; // tijd van de laatste flank van de knop, zie handleInput()
 
 LedControl lc = LedControl(PIN_DATAIN, PIN_CLK, PIN_LOAD, 2);
-NonBlockDelay d;
+Neck neck;
+Sequencer sequencer;
+FrameRate frameRate;
+PowerManager power;
+Melody melody;
+Compositor compositor;
+Animation animation;
+// Tot dit moment staat de resterende tijd over het zand
+unsigned long overlayUntil;
+// Laatste geldige richting, zodat alleen echt draaien de tijd toont en niet de
+// eerste meting of een richting die even wegvalt (-1)
+int overlayGravity = -1;
+#if CAPTURE
+// millis() van de laatste momentopname in de invoeropname
+unsigned long lastSnapshot;
+#endif
+#if SAND_ENGINE == SAND_ENGINE_MARGOLUS
+Margolus margolus;
+#elif SAND_ENGINE == SAND_ENGINE_PARTICLES
+Particles particles;
+static_assert(GRAINS <= PARTICLE_MAX, "niet alle korrels passen in Particles");
+#endif
 // OBSOLUTE int resetCounter = 0;
 bool alarmWentOff = true;
 
-long getDelayDrop()
+Persist persist;
+calibration cal = {
+    {ACC_CENTER, ACC_CENTER},
+    {ACC_FULL_SCALE, ACC_FULL_SCALE},
+    {(ACC_THRESHOLD_HIGH - ACC_THRESHOLD_LOW) / 2, (ACC_THRESHOLD_HIGH - ACC_THRESHOLD_LOW) / 2}};
+// Korrels door de hals sinds het vullen
+byte grainsTransferred = 0;
+// De toestand moet nog in EEPROM worden bewaard; saveNow slaat PERSIST_INTERVAL over
+bool stateDirty = false;
+bool saveNow = false;
+
+// Aantal modes: de gewone tijden, de programma's en het programma uit EEPROM als dat er is
+byte modeCount()
+{
+    program p;
+
+    return PLAIN_MODES + BUILTIN_PROGRAMS + (Sequencer::read(p) ? 1 : 0);
+}
+
+// Begin het programma van een mode, vanaf het segment position
+void beginMode(int mode, byte position)
+{
+    program p;
+
+    if (mode < (int)PLAIN_MODES)
+    {
+        sequencer.begin(modes[mode], GRAINS);
+        return;
+    }
+    if (mode < (int)(PLAIN_MODES + BUILTIN_PROGRAMS))
+        memcpy_P(&p, &programs[mode - PLAIN_MODES], sizeof(program));
+    else if (!Sequencer::read(p))
+    {
+        // Het programma staat niet meer in EEPROM: de standaardmode
+        sequencer.begin(modes[1], GRAINS);
+        return;
+    }
+    sequencer.begin(p, position);
+}
+
+// Laat de hals het segment van de sequencer aflopen, vanaf korrel first
+void startSegment(byte first, unsigned long firstDelay)
 {
-    // Get delay between particle drops (in seconds)
-    return delaySeconds;
+    neck.start(sequencer.table(), sequencer.grains(), first, firstDelay);
 }
 
 coord getDown(int x, int y)
@@ -175,10 +299,13 @@ bool moveParticle(int addr, int x, int y)
     {
         goRight(addr, x, y);
     }
+    PROFILE_COUNT(grainsMoved, 1);
     return true;
 }
 
-void fill(int addr, int maxcount)
+// Vul een matrix met maxcount korrels, onderaan beginnend, in een buffer met
+// dezelfde bitvolgorde als LedControl::getRow. Schrijven gaat daarna met setAll().
+void fill(byte rows[8], int maxcount)
 {
     int n = 8;
     byte x, y;
@@ -190,72 +317,134 @@ void fill(int addr, int maxcount)
         {
             y = 7 - j;
             x = (slice - j);
-            lc.setXY(addr, x, y, (++count <= maxcount));
+            coord xy = lc.transform(x, y);
+            if (++count <= maxcount)
+                rows[xy.y] |= B10000000 >> xy.x;
+            else
+                rows[xy.y] &= ~(B10000000 >> xy.x);
         }
     }
 }
 
-int getGravity()
+// Kopieer een teken uit Cijfers.h, met het merkteken voor minuten of uren erbij
+void glyphCopy(byte rows[8], byte glyph)
 {
+    memcpy_P(rows, cijfers[glyph & GLYPH_MASK], 8);
+    if (glyph & MARK_MINUTES)
+    {
+        for (byte i = 0; i < 3; i++)
+            rows[i] |= B00000001;
+    }
+    if (glyph & MARK_HOURS)
+    {
+        rows[6] |= B00000001;
+        rows[7] |= B00000001;
+    }
+}
 
-    // --------------------------------------------------
-    // Variabelen voor de berekende richtingen
-    // xCalc en yCalc krijgen alleen de waarden: -1, 0 of 1
-    // --------------------------------------------------
-    int xCalc = 0;
-    int yCalc = 0;
+// Zet twee tekens uit Cijfers.h in rows, zoals LedControl::setAll ze verwacht: tens op B, units op A
+void glyphRows(byte rows[16], byte tens, byte units)
+{
+    glyphCopy(&rows[MATRIX_A * 8], units);
+    glyphCopy(&rows[MATRIX_B * 8], tens);
+}
 
-    // --------------------------------------------------
-    // Lees de ruwe ADC-waarden van de ADXL335
-    // Waarden liggen typisch tussen 0 en 1023
-    // --------------------------------------------------
-    int x = analogRead(PIN_X);
-    int y = analogRead(PIN_Y);
+// Zet twee tekens uit Cijfers.h op de matrices in een keer
+void showGlyphs(byte tens, byte units)
+{
+    byte rows[16];
 
-    // --------------------------------------------------
-    // Zet de X-as om naar -1, 0 of 1
-    // -1 : onder de lage drempel
-    //  0 : binnen de deadzone
-    //  1 : boven de hoge drempel
-    // --------------------------------------------------
-    if (x < ACC_THRESHOLD_LOW)
+    glyphRows(rows, tens, units);
+    lc.setAll(rows);
+}
+// Kies de tekens voor een tijd, steeds naar boven afgerond: tot 99 seconden in
+// seconden, tot 99 minuten in minuten met een " erachter (vanaf 10 minuten een
+// streepje aan het tweede cijfer) en daarboven in uren met een u erachter. Voor
+// 10 uur of meer is er geen plaats voor de u, dan krijgt het tweede cijfer een punt.
+void timeGlyphs(long seconds, byte &tens, byte &units)
+{
+    if (seconds < 100)
     {
-        xCalc = -1;
+        tens = seconds / 10;
+        units = seconds % 10;
+        return;
     }
-    else if (x <= ACC_THRESHOLD_HIGH)
-    {
-        xCalc = 0;
+    long minutes = (seconds + 59) / 60;
+    if (minutes < 10)
+    { // 2 of 5 minuten = 1 minuut met " teken erachter
+        tens = minutes;
+        units = ACCENT;
+        return;
     }
-    else
+    if (minutes < 100)
+    { // 25 minuten = 2 en 5 met een streepje erachter
+        tens = minutes / 10;
+        units = (minutes % 10) | MARK_MINUTES;
+        return;
+    }
+    long hours = (minutes + 59) / 60;
+    if (hours < 10)
     {
-        xCalc = 1;
+        tens = hours;
+        units = LETTER_U;
+        return;
     }
+    hours = min(hours, 99L);
+    tens = hours / 10;
+    units = (hours % 10) | MARK_HOURS;
+}
+
+// Zet een ruwe ADC-waarde om naar -1, 0 of 1 met de kalibratie van die as
+int classifyAxis(int value, byte axis)
+{
+    int deviation = value - cal.zero[axis];
+
+    if (deviation < -cal.band[axis])
+        return -1;
+    if (deviation > cal.band[axis])
+        return 1;
+    return 0;
+}
+
+// --------------------------------------------------
+// Lees de ruwe ADC-waarden van de ADXL335 direct, buiten loop()
+// Waarden liggen typisch tussen 0 en 1023
+// --------------------------------------------------
+void readAccelerometer()
+{
+    input.finish();
+    accX = analogRead(PIN_X);
+    accY = analogRead(PIN_Y);
+#if CAPTURE
+    capture.sample(accX, accY, millis(), true);
+#endif
+}
+
+// Bepaal de richting uit de laatst gelezen accX en accY
+int classifyGravity()
+{
 
     // --------------------------------------------------
-    // Zet de Y-as om naar -1, 0 of 1
-    // Zelfde logica als bij de X-as
+    // Variabelen voor de berekende richtingen
+    // xCalc en yCalc krijgen alleen de waarden: -1, 0 of 1
     // --------------------------------------------------
-    if (y < ACC_THRESHOLD_LOW)
-    {
-        yCalc = -1;
-    }
-    else if (y <= ACC_THRESHOLD_HIGH)
-    {
-        yCalc = 0;
-    }
-    else
-    {
-        yCalc = 1;
-    }
+    int xCalc = 0;
+    int yCalc = 0;
+
+    // --------------------------------------------------
+    // Zet beide assen om naar -1, 0 of 1 met de kalibratie
+    // -1 : onder het nulpunt min de dode zone
+    //  0 : binnen de dode zone
+    //  1 : boven het nulpunt plus de dode zone
+    // --------------------------------------------------
+    xCalc = classifyAxis(accX, 0);
+    yCalc = classifyAxis(accY, 1);
 
     // --------------------------------------------------
     // Bepaal de richting op basis van xCalc en yCalc
     // Alleen de vier hoofdassen worden herkend
     // --------------------------------------------------
-    // Serial.print("xCalc: ");
-    // Serial.print(xCalc);
-    // Serial.print(" | yCalc: ");
-    // Serial.println(yCalc);
+    LOG_DEBUG(LOG_AXES, xCalc, yCalc);
     if (xCalc == -1 && yCalc == 0)
     {
         return 0; // Omlaag
@@ -278,30 +467,326 @@ int getGravity()
     // --------------------------------------------------
     return -1;
 }
+
+int getGravity()
+{
+    readAccelerometer();
+    return classifyGravity();
+}
+
+#if CAPTURE
+// Maak van de 16 bits tijd van een gebeurtenis weer een volledige millis()
+unsigned long eventTime(unsigned int time)
+{
+    unsigned long now = millis();
+    return now - (unsigned int)((unsigned int)now - time);
+}
+#endif
+
+// Verwerk alle gebeurtenissen van de interrupts sinds het vorige frame:
+// de meting van de accelerometer en de flanken van de knop.
+// Returns : true als de knop is ingedrukt
+bool handleInput()
+{
+    inputEvent e;
+    bool pressed = false;
+
+    while (input.next(e))
+    {
+        switch (e.type)
+        {
+        case EVENT_ADC_X:
+            accX = e.value;
+            break;
+        case EVENT_ADC_Y:
+            accY = e.value;
+#if CAPTURE
+            capture.sample(accX, accY, eventTime(e.time), false);
+#endif
+            break;
+        case EVENT_BUTTON:
+#if CAPTURE
+            capture.button(e.value == LOW, eventTime(e.time));
+#endif
+            // Alleen een flank na een rustige periode telt, de rest is dender
+            if (e.value == LOW && (unsigned int)(e.time - buttonQuiet) >= BUTTON_DEBOUNCE)
+                pressed = true;
+            buttonQuiet = e.time;
+            break;
+        }
+    }
+    return pressed;
+}
+
+// Vergeet de knop tot nu, na een menu of standby waarin hij direct is gelezen
+void ignoreButton()
+{
+#if CAPTURE
+    // De flanken horen wel in de opname
+    handleInput();
+#else
+    input.clear();
+#endif
+    buttonQuiet = millis();
+}
+
+// Volgens de zwaartekracht van dit frame
 int getTopMatrix()
 {
-    return (getGravity() == 90) ? MATRIX_A : MATRIX_B;
+    return (gravity == 90) ? MATRIX_A : MATRIX_B;
+}
+
+// Bewaar de toestand bij het volgende checkpoint, met now zo snel mogelijk
+void markDirty(bool now)
+{
+    stateDirty = true;
+    if (now)
+        saveNow = true;
+}
+
+// De toestand zoals Persist die bewaart
+void buildRecord(persistRecord &r)
+{
+    r.mode = currentMode;
+    memcpy(&r.cal, &cal, sizeof(calibration));
+    for (byte i = 0; i < 8; i++)
+    {
+        r.boards[i] = lc.getRow(MATRIX_A, i);
+        r.boards[8 + i] = lc.getRow(MATRIX_B, i);
+    }
+    r.transferred = grainsTransferred;
+    long untilDrop = neck.deadline() - millis();
+    r.nextDrop = constrain(untilDrop, 0L, 65535L);
+    r.segment = sequencer.index();
+    r.grain = neck.position();
+    r.flags = alarmWentOff ? 0 : PERSIST_RUNNING;
+}
+
+void saveState()
+{
+    persistRecord r;
+
+    persist.service();
+    if (!stateDirty || !persist.ready(saveNow))
+        return;
+
+    buildRecord(r);
+    persist.checkpoint(r);
+    stateDirty = false;
+    saveNow = false;
+}
+
+#if CAPTURE
+// Begin de random generators opnieuw, ook die van de zandmotor
+void reseed(unsigned int seed)
+{
+    randomSeed(seed);
+#if SAND_ENGINE == SAND_ENGINE_MARGOLUS
+    margolus.setSeed(seed);
+#endif
+}
+
+// Leg de toestand vast in de opname en begin de random generators opnieuw met
+// een bekend zaad, zodat tools/replay vanaf hier hetzelfde zand laat vallen
+void captureSnapshot(unsigned long now, byte reason)
+{
+    persistRecord r;
+    captureMoment m;
+
+    m.seed = random(1, 65536);
+    buildRecord(r);
+    reseed(m.seed);
+    // Die van de ring schuiven de vaste niet op; die vallen dan ook bij het naspelen op dezelfde tijd
+    if (reason != CAP_REASON_RING)
+        lastSnapshot = now;
+    m.reason = reason;
+    m.time = now;
+    m.fixed = lastSnapshot;
+    m.active = frameRate.lastActivity();
+    m.frame = frameRate.frameStart();
+    m.gravity = lastGravity;
+    capture.snapshot(r, m);
+}
+#endif
+
+// Een commando van de seriele poort, dat ook in de opname komt
+bool receiveCommand(protocolFrame &frame)
+{
+    if (!protocol.receive(frame))
+        return false;
+#if CAPTURE
+    capture.command(frame);
+#endif
+    return true;
+}
+
+// Ga verder met een bewaarde toestand: de matrices in een keer, het schema waar het was
+void resumeRun(const persistRecord &r)
+{
+    if (r.mode < modeCount())
+        currentMode = r.mode;
+    // Een record zonder bruikbare kalibratie laat de standaardwaarden staan
+    if (r.cal.scale[0] >= CAL_MIN_SCALE && r.cal.scale[1] >= CAL_MIN_SCALE)
+        memcpy(&cal, &r.cal, sizeof(calibration));
+
+    byte rows[16];
+    memcpy(rows, r.boards, sizeof(rows));
+    lc.setAll(rows);
+#if SAND_ENGINE == SAND_ENGINE_PARTICLES
+    particles.load(lc);
+#endif
+
+    beginMode(currentMode, r.segment);
+    startSegment(r.grain, r.nextDrop);
+    grainsTransferred = r.transferred;
+    alarmWentOff = !(r.flags & PERSIST_RUNNING);
+    LOG_INFO(LOG_RESUME, sequencer.seconds(), grainsTransferred);
 }
-int getBottomMatrix()
+
+// Al het zand bovenin, zoals de zandloper nu staat: in de matrix waar de hals uit stroomt
+void fillTop()
 {
-    return (getGravity() != 90) ? MATRIX_A : MATRIX_B;
+    int source = neck.source(gravity);
+    // Het hele beeld in een keer: 8 transacties in plaats van een per pixel
+    byte rows[16];
+    memset(rows, 0, sizeof(rows));
+    fill(&rows[(source == -1 ? getTopMatrix() : source) * 8], GRAINS);
+    lc.setAll(rows);
+#if SAND_ENGINE == SAND_ENGINE_PARTICLES
+    particles.load(lc);
+#endif
+    grainsTransferred = 0;
 }
 
 void resetTime()
 {
-    for (byte i = 0; i < 2; i++)
-        lc.clearDisplay(i);
-    fill(getTopMatrix(), 60);
-    d.Delay(getDelayDrop() * 0);
-    d.Delay(1000);
+    gravity = getGravity(); // het zand begint bovenin zoals hij nu staat
+    fillTop();
 
-    delaySeconds = (1000L * modes[currentMode]) / 60; // 1000 miliseconde per seconde, gedeeld door 60 zandkorrels
-    Serial.print("Current mode: ");
-    Serial.println(modes[currentMode]);
-    Serial.print("Delay per particle: ");
-    Serial.println(delaySeconds);
+    beginMode(currentMode, 0);
+    startSegment(0, sequencer.table()[0]);
+    markDirty(true);
+    LOG_INFO(LOG_MODE, sequencer.seconds(), sequencer.table()[0]);
+}
+
+// Signalen tussen twee segmenten van een programma
+const static note flipCue[] PROGMEM = {
+    {660, 120, 180}, {880, 120, 180}, {660, 120, 180}, {880, 240, 240}};
+const static note refillCue[] PROGMEM = {
+    {880, 100, 140}, {780, 100, 140}, {700, 100, 140}, {660, 200, 200}};
+
+// Het segment is voorbij en het zand ligt stil: door naar het volgende
+void nextSegment()
+{
+    // De cue hoort bij het segment dat net voorbij is
+    byte cue = sequencer.cue();
+
+    if (!sequencer.next())
+    {
+        // Na het laatste segment loopt het weer zoals na het omdraaien
+        startSegment(0, sequencer.table()[0]);
+        return;
+    }
+    if (cue == CUE_REFILL)
+    {
+        fillTop();
+        melody.play(refillCue, sizeof(refillCue) / sizeof(refillCue[0]));
+    }
+    else if (cue == CUE_FLIP)
+        melody.play(flipCue, sizeof(flipCue) / sizeof(flipCue[0]));
+    startSegment(0, sequencer.table()[0]);
+    frameRate.activity();
+    markDirty(true);
+    LOG_INFO(LOG_SEGMENT, sequencer.index(), sequencer.seconds());
+}
+#if OVERLAY_TIME
+// Toon de resterende tijd over het lopende zand. De simulatie loopt gewoon door,
+// XOR houdt de cijfers leesbaar op zowel vol als leeg zand.
+void showRemainingTime()
+{
+    int destination = neck.destination(gravity);
+    byte tens, units;
+    byte rows[16];
+
+    if (destination == -1)
+        return;
+    long seconds = (neck.timeFor(countParticles(neck.source(gravity))) + 999) / 1000;
+    timeGlyphs(seconds, tens, units);
+    glyphRows(rows, tens, units);
+    for (byte i = 0; i < 8; i++)
+    {
+        compositor.setRow(MATRIX_A, i, rows[MATRIX_A * 8 + i]);
+        compositor.setRow(MATRIX_B, i, rows[MATRIX_B * 8 + i]);
+    }
+    compositor.show(lc, BLEND_XOR);
+    overlayUntil = millis() + OVERLAY_TIME;
+}
+#endif
+
+#if SAND_ENGINE == SAND_ENGINE_MARGOLUS
+// Lees een matrix als bitboard in logische coordinaten: bit x van rows[y] is cel (x,y)
+void readBoard(int addr, byte rows[8])
+{
+    for (byte y = 0; y < 8; y++)
+    {
+        rows[y] = 0;
+        for (byte x = 0; x < 8; x++)
+        {
+            if (lc.getXY(addr, x, y))
+                rows[y] |= 1 << x;
+        }
+    }
+}
+// Schrijf alleen de cellen die veranderd zijn
+void writeBoard(int addr, const byte before[8], const byte after[8])
+{
+    for (byte y = 0; y < 8; y++)
+    {
+        byte changed = before[y] ^ after[y];
+        for (byte x = 0; changed; x++, changed >>= 1)
+        {
+            if (changed & 1)
+                lc.setXY(addr, x, y, (after[y] >> x) & 1);
+            // Elke verplaatste korrel laat een cel leeg
+            if ((changed & 1) && !((after[y] >> x) & 1))
+                PROFILE_COUNT(grainsMoved, 1);
+        }
+    }
 }
 bool updateMatrix()
+{
+    bool somethingMoved = false;
+    byte before[8];
+    byte after[8];
+
+    for (byte addr = 0; addr < 2; addr++)
+    {
+        readBoard(addr, before);
+        memcpy(after, before, 8);
+        if (margolus.step(after))
+        {
+            writeBoard(addr, before, after);
+            somethingMoved = true;
+        }
+    }
+    margolus.nextPhase();
+    return somethingMoved;
+}
+#elif SAND_ENGINE == SAND_ENGINE_PARTICLES
+// De zwaartekracht volgt de echte kantelhoek, ook diagonaal. In ruwe coordinaten
+// wijst de X-as van de accelerometer langs (1,1) en de Y-as langs (1,-1).
+bool updateMatrix()
+{
+    // Herschaal naar ACC_FULL_SCALE bij 1g, zodat PARTICLE_GAIN op elk bord hetzelfde betekent
+    int ax = ((long)(accX - cal.zero[0]) * ACC_FULL_SCALE) / cal.scale[0];
+    int ay = ((long)(accY - cal.zero[1]) * ACC_FULL_SCALE) / cal.scale[1];
+    bool somethingMoved = particles.step(ax + ay, ax - ay, neck.owed());
+
+    particles.render(lc);
+    return somethingMoved;
+}
+#else
+bool updateMatrix()
 {
     int n = 8;
     bool somethingMoved = false;
@@ -327,117 +812,429 @@ bool updateMatrix()
     }
     return somethingMoved;
 }
-boolean dropParticle()
+#endif
+#if SAND_ENGINE == SAND_ENGINE_PARTICLES
+// De korrels zijn in updateMatrix() al door de hals gegaan, hier wordt alleen het schema bijgewerkt
+byte dropParticles()
+{
+    byte n = particles.crossed();
+
+    if (neck.owed() > 1)
+        PROFILE_COUNT(deadlineMisses, neck.owed() - 1);
+    for (byte i = 0; i < n; i++)
+        neck.advance();
+    if (n == 0 && neck.owed() > 0)
+        neck.skip();
+    if (n > 0)
+        tone(PIN_BUZZER, 440, 10);
+    return n;
+}
+
+#ifdef PARTICLE_REPORT
+// Rekentijd van de korrels, eens per 50 frames. logdecode.py rekent dit om naar klokcycli.
+void reportParticles()
+{
+    static byte frames = 0;
+    if (++frames < 50)
+        return;
+    frames = 0;
+    LOG_INFO(LOG_PARTICLE_TIME, particles.frameMicros(), particles.peakMicros());
+}
+#endif
+#else
+#if NECK_TILT_FLOW
+// Doorstroming op basis van de uitslag langs de as van de huidige richting
+byte getTiltFlow()
 {
-    if (d.Timeout())
+    byte axis = (gravity == 0 || gravity == 180) ? 0 : 1;
+    long deviation = abs((axis == 0 ? accX : accY) - cal.zero[axis]);
+
+    if (deviation >= cal.scale[axis])
+        return NECK_FLOW_FULL;
+    return (deviation * NECK_FLOW_FULL) / cal.scale[axis];
+}
+#endif
+
+// Laat de korrels door de hals vallen die volgens het schema aan de beurt zijn.
+// Geeft het aantal verplaatste korrels terug.
+byte dropParticles()
+{
+#if NECK_TILT_FLOW
+    neck.setFlow(getTiltFlow());
+#endif
+    byte count = neck.due(gravity);
+    byte n = 0;
+
+    // Meer dan een korrel tegelijk betekent dat we een deadline hebben gemist
+    if (count > 1)
+        PROFILE_COUNT(deadlineMisses, count - 1);
+
+    while (n < count)
     {
-        d.Delay(getDelayDrop());
-        if (gravity == 0 || gravity == 180)
+        if (!neck.transfer(lc, gravity))
         {
-            if ((lc.getRawXY(MATRIX_A, 0, 0) && !lc.getRawXY(MATRIX_B, 7, 7)) ||
-                (!lc.getRawXY(MATRIX_A, 0, 0) && lc.getRawXY(MATRIX_B, 7, 7)))
-            {
-                lc.invertRawXY(MATRIX_A, 0, 0);
-                lc.invertRawXY(MATRIX_B, 7, 7);
-                tone(PIN_BUZZER, 440, 10);
-                return true;
-            }
+            neck.skip();
+            break;
         }
+        n++;
+        // Maak de hals vrij zodat de volgende korrel in hetzelfde frame kan vallen
+        coord xy = neck.entry(gravity);
+        moveParticle(neck.destination(gravity), xy.x, xy.y);
     }
-    return false;
+    if (n > 0)
+        tone(PIN_BUZZER, 440, 10);
+    return n;
 }
+#endif
 void alarm()
 {
-    Serial.println("Alarm!");
+    LOG_INFO(LOG_ALARM);
     for (int i = 0; i < 10; i++)
     {
         tone(PIN_BUZZER, 600 - (20 * i), 110);
         delay(180);
     }
 }
+// Oplopende tonen, speelt op de achtergrond terwijl de zandloper al loopt
+const static note startupMelody[] PROGMEM = {
+    {440, 110, 20}, {460, 110, 20}, {480, 110, 20}, {500, 110, 20}, {520, 110, 20},
+    {540, 110, 20}, {560, 110, 20}, {580, 110, 20}, {600, 110, 20}, {620, 110, 20}};
+
 void alarmStartup()
 {
-    Serial.println("Starting sound!");
-    for (int i = 0; i < 10; i++)
+    LOG_INFO(LOG_STARTUP_SOUND);
+    melody.play(startupMelody, sizeof(startupMelody) / sizeof(startupMelody[0]));
+}
+
+// Vervang de gemeten richting door de richting die de host heeft opgelegd. De ruwe
+// waarden worden ook aangepast, zodat de korrels en de hals hetzelfde zien.
+void applyGravityOverride()
+{
+    if (gravityOverride == GRAVITY_AUTO)
+        return;
+    gravity = gravityOverride;
+    if (gravity == 0 || gravity == 180)
     {
-        tone(PIN_BUZZER, 440 + (20 * i), 110);
-        delay(20);
+        accX = cal.zero[0] + (gravity == 0 ? -cal.scale[0] : cal.scale[0]);
+        accY = cal.zero[1];
+    }
+    else if (gravity == 90 || gravity == 270)
+    {
+        accX = cal.zero[0];
+        accY = cal.zero[1] + (gravity == 270 ? -cal.scale[1] : cal.scale[1]);
     }
 }
 
-/**
- * Setup
- */
-void setup()
+// Stuur de huidige toestand: beide matrices, het aantal korrels, de richting en de mode
+void sendState()
 {
-    pinMode(PIN_BUTTON, INPUT_PULLUP); // Activeert de interne weerstand
-
-    Serial.begin(9600);
-    Serial.println("Starting Zandloper");
-    alarmStartup();
-    randomSeed(analogRead(A0));
+    byte payload[21];
 
-    for (byte i = 0; i < 2; i++)
+    payload[16] = 0;
+    payload[17] = 0;
+    for (byte i = 0; i < 8; i++)
     {
-        lc.shutdown(i, false);
-        lc.setIntensity(i, 1);
-        lc.clearDisplay(i);
+        payload[i] = lc.getRow(MATRIX_A, i);
+        payload[8 + i] = lc.getRow(MATRIX_B, i);
+        // Tel de bits direct uit de rijen, dat is goedkoper dan countParticles()
+        for (byte row = payload[i]; row; row &= row - 1)
+            payload[16]++;
+        for (byte row = payload[8 + i]; row; row &= row - 1)
+            payload[17]++;
     }
+    payload[18] = gravity & 0xFF;
+    payload[19] = gravity >> 8;
+    payload[20] = currentMode;
+    protocol.send(FRAME_STATE, payload, sizeof(payload));
+}
+
+// Stuur het SRAM-gebruik
+void sendMemory()
+{
+    int values[3];
 
-    resetTime();
+    values[0] = memoryFree();
+    values[1] = memoryHeadroom();
+    values[2] = memoryStackUsed();
+    protocol.send(FRAME_MEMORY, (byte *)values, sizeof(values));
 }
-// Functie om een getal te splitsen en te tonen
-void toonGetal(int getal)
+
+// Controleer eens per seconde of de stack te dicht bij de heap is gekomen.
+// Met MEMORY_TRAP stopt de zandloper dan, anders wordt het eenmalig gemeld.
+void checkMemory()
+{
+    static unsigned long lastCheck = 0;
+    static bool reported = false;
+
+    if (reported || millis() - lastCheck < 1000)
+        return;
+    lastCheck = millis();
+    if (!memoryGuardBreached())
+        return;
+    reported = true;
+    LOG_ERROR(LOG_MEMORY_LOW, memoryHeadroom());
+#ifdef MEMORY_TRAP
+    logger.flush();
+    for (byte i = 0; i < 2; i++)
+        lc.shutdown(i, true);
+    tone(PIN_BUZZER, 220);
+    for (;;)
+        ;
+#endif
+}
+
+// Meld het als er sinds de vorige keer invoer of frames niet meer in hun buffer pasten
+void checkDropped()
+{
+    static byte lastEvents = 0;
+    static unsigned int lastFrames = 0;
+    byte events = input.dropped();
+    unsigned int frames = protocol.droppedFrames();
+
+    if (events == lastEvents && frames == lastFrames)
+        return;
+    lastEvents = events;
+    lastFrames = frames;
+    LOG_WARN(LOG_QUEUE_DROPPED, events, frames);
+}
+
+// Wacht tot de knop is ingedrukt en weer losgelaten, of tot de host CMD_CALIBRATE
+// stuurt. Andere commando's worden zolang genegeerd. Geeft false na CALIBRATE_TIMEOUT.
+bool waitForConfirm()
 {
-    int tiental = getal / 10;
-    int eenheid = getal % 10;
+    unsigned long start = millis();
+    protocolFrame frame;
 
-    for (int i = 0; i < 8; i++)
+    while (millis() - start < CALIBRATE_TIMEOUT)
     {
-        // Tiental op display 0, eenheid op display 1
-        lc.setRow(1, i, cijfers[tiental][i]);
-        lc.setRow(0, i, cijfers[eenheid][i]);
+        logger.drain();
+        protocol.service();
+#if CAPTURE
+        ignoreButton();
+#endif
+        while (receiveCommand(frame))
+        {
+            if (frame.type == CMD_CALIBRATE)
+                return true;
+        }
+        if (digitalRead(PIN_BUTTON) == LOW)
+        {
+            while (digitalRead(PIN_BUTTON) == LOW)
+            {
+                yield(); // Laat andere taken toe terwijl we wachten
+            }
+            // Laat de zandloper tot rust komen na het loslaten van de knop
+            delay(300);
+            return true;
+        }
     }
+    return false;
 }
-void displayMode(int mode)
-{
 
-    if (mode <= 1)
-    { // 30 of 60 seconden
-        int tiental = modes[mode] / 10;
-        int eenheid = modes[mode] % 10;
+// Kalibreer de accelerometer. De zandloper wordt achtereenvolgens in de standen
+// 0, 90, 180 en 270 graden gelegd, het nummer van de stand (1..4) staat op de
+// matrices. Elke stand wordt bevestigd met de knop of met CMD_CALIBRATE.
+// Een geslaagde kalibratie wordt direct in EEPROM bewaard.
+void calibrateAccelerometer()
+{
+    Calibrator calibrator;
+    byte orientation = 0;
 
-        for (int i = 0; i < 8; i++)
+    input.finish();
+    compositor.hide(lc);
+    lc.setIntensityAll(DISPLAY_INTENSITY);
+    LOG_INFO(LOG_CALIBRATE);
+    while (orientation < 4)
+    {
+        showGlyphs(BLANK, orientation + 1);
+        if (!waitForConfirm())
+        {
+            LOG_WARN(LOG_CALIBRATION_FAILED);
+            return;
+        }
+#if CAPTURE
+        // De Calibrator leest zelf; in de opname staat deze ene meting per stand
+        readAccelerometer();
+#endif
+        if (calibrator.sample(orientation, PIN_X, PIN_Y))
+        {
+            tone(PIN_BUZZER, 880, 50);
+            orientation++;
+        }
+        else
         {
-            // Tiental op display 0, eenheid op display 1
-            lc.setRow(1, i, cijfers[tiental][i]);
-            lc.setRow(0, i, cijfers[eenheid][i]);
+            // Niet stil gehouden: dezelfde stand nog een keer
+            LOG_WARN(LOG_CALIBRATION_UNSTABLE, orientation * 90, calibrator.spread());
+            tone(PIN_BUZZER, 220, 200);
         }
     }
-    else
-    { // 2, 5 of 10 minuten = > 1 minuut
-        int minutes = modes[mode] / 60;
 
-        int tiental = minutes;
-        // int eenheid = modes[mode] % 10;
+    if (!calibrator.compute(cal))
+    {
+        LOG_WARN(LOG_CALIBRATION_FAILED);
+        tone(PIN_BUZZER, 220, 500);
+        return;
+    }
+    LOG_INFO(LOG_CALIBRATED, cal.zero[0], cal.zero[1]);
+    markDirty(true);
+#if CAPTURE
+    // tools/replay neemt de kalibratie uit de momentopname over
+    captureSnapshot(millis(), CAP_REASON_FIXED);
+#endif
+}
 
-        for (int i = 0; i < 8; i++)
+// Voer de commando's uit die via het protocol zijn binnengekomen
+void handleCommands()
+{
+    protocolFrame frame;
+
+    while (receiveCommand(frame))
+    {
+        int value = frame.length >= 2 ? (int)(frame.payload[0] | (frame.payload[1] << 8)) : 0;
+
+        switch (frame.type)
         {
-            // Tiental op display 0, eenheid op display 1
-            if (minutes < 10)
-            { // 2 of 5 minuten = 1 minuut met " teken erachter
-                lc.setRow(1, i, cijfers[tiental][i]);
-                lc.setRow(0, i, cijfers[ACCENT][i]); // " teken
+        case CMD_STREAM:
+            streamPeriod = value;
+            break;
+        case CMD_MODE:
+            if (frame.length >= 1 && frame.payload[0] < modeCount())
+            {
+                currentMode = frame.payload[0];
+                resetTime();
+                alarmWentOff = true;
             }
-            else
-            { // 10 minuten = 1 met " teken erachter
-                lc.setRow(1, i, cijfers[CIJFER_1][i]);
-                lc.setRow(0, i, cijfers[CIJFER_0ACCENT][i]); // 0 met " teken erachter
+            break;
+        case CMD_PROGRAM:
+        {
+            program p;
+
+            memset(&p, 0, sizeof(p));
+            memcpy(&p, frame.payload, min(frame.length, (byte)sizeof(p)));
+            if (Sequencer::valid(p))
+            {
+                Sequencer::write(p);
+                currentMode = PLAIN_MODES + BUILTIN_PROGRAMS;
+                resetTime();
+                alarmWentOff = true;
             }
+            break;
+        }
+        case CMD_GRAVITY:
+            // Alleen de vier richtingen, -1 (plat) of GRAVITY_AUTO; al het andere negeren
+            if (value == GRAVITY_AUTO || value == -1 || (value >= 0 && value < 360 && value % 90 == 0))
+                gravityOverride = value;
+            break;
+        case CMD_RESET:
+            resetTime();
+            alarmWentOff = true;
+            break;
+        case CMD_MEMORY:
+            sendMemory();
+            break;
+        case CMD_CALIBRATE:
+            calibrateAccelerometer();
+            ignoreButton();
+            resetTime();
+            alarmWentOff = true;
+            break;
+#if CAPTURE
+        case CMD_CAPTURE:
+            capture.action(frame.length > 0 ? frame.payload[0] : CAPTURE_DUMP);
+            break;
+#endif
+#ifdef ZANDLOPER_PROFILE
+        case CMD_PROFILE:
+            // De tekst gaat buiten de zendbuffer om, dus eerst alle frames versturen
+            protocol.flush();
+            profile.dump();
+            profile.reset();
+            break;
+#endif
         }
+        frameRate.activity();
     }
 }
 
+// Zet de matrices uit en slaap tot de knop wordt ingedrukt of de zandloper wordt gedraaid
+void standby()
+{
+    int g = getGravity();
+
+    compositor.hide(lc);
+    LOG_INFO(LOG_STANDBY, power.dutyCycle());
+    logger.flush();
+
+    // Een EEPROM-record moet af zijn voordat de processor gaat slapen
+    while (persist.busy())
+        persist.service();
+    for (byte i = 0; i < 2; i++)
+        lc.shutdown(i, true);
+    while (digitalRead(PIN_BUTTON) == HIGH && getGravity() == g)
+        power.powerDown();
+    for (byte i = 0; i < 2; i++)
+        lc.shutdown(i, false);
+    // powerDown() heeft de knopinterrupt voor het wekken gebruikt
+    input.attach();
+    ignoreButton();
+
+    frameRate.activity();
+}
+
+/**
+ * Setup
+ */
+void setup()
+{
+    LOG_INFO(LOG_BOOT);
+    pinMode(PIN_BUTTON, INPUT_PULLUP); // Activeert de interne weerstand
+    power.begin(PIN_BUTTON);
+    input.begin(PIN_BUTTON, PIN_X, PIN_Y);
+
+    // Eerst het beeld: de matrices in een keer aanzetten en het eerste frame schrijven.
+    // Na stroomuitval gaan we verder waar we waren, anders begint een nieuwe zandloper.
+    lc.begin(DISPLAY_INTENSITY);
+    persistRecord r;
+    if (persist.load(r))
+        resumeRun(r);
+    else
+        resetTime();
+    unsigned long firstFrame = micros();
+
+    // Daarna de rest; het geluid speelt vanuit loop()
+    protocol.begin();
+    LOG_INFO(LOG_FIRST_FRAME, firstFrame / 1000, firstFrame % 1000);
+    melody.begin(PIN_BUZZER);
+    alarmStartup();
+    randomSeed(analogRead(A0));
+#ifdef ZANDLOPER_PROFILE
+    profile.reset();
+    profile.firstFrame = firstFrame;
+#endif
+#if SAND_ENGINE == SAND_ENGINE_MARGOLUS
+    margolus.setSeed(random(1, 65536));
+#endif
+#if CAPTURE
+    captureSnapshot(millis(), CAP_REASON_BOOT);
+#endif
+    input.sample();
+}
+// Zet de tekens van een mode in rows, zoals LedControl::setAll ze verwacht
+void displayMode(int mode, byte rows[16])
+{
+    byte tens, units;
+
+    if (mode < (int)PLAIN_MODES)
+        timeGlyphs(modes[mode], tens, units);
+    else
+    {
+        // P1, P2, ... voor de programma's
+        tens = LETTER_P;
+        units = mode - PLAIN_MODES + 1;
+    }
+    glyphRows(rows, tens, units);
+}
+
 // Functie om de button delay te meten. Geeft terug hoe lang er op de knop werd gedrukt in miliseconden. De functie wacht tot de button wordt losgelaten voordat hij de tijd teruggeeft.
 long getButtonDelay()
 {
@@ -448,8 +1245,13 @@ long getButtonDelay()
         // Wacht tot de button wordt losgelaten
         yield(); // Laat andere taken toe terwijl we wachten
     }
-    for (byte i = 0; i < 2; i++)
-        lc.clearDisplay(i);
+    // Lang genoeg ingedrukt om het menu te verlaten: maak het beeld leeg als teken
+    if (digitalRead(PIN_BUTTON) == LOW)
+    {
+        compositor.clear(MATRIX_A);
+        compositor.clear(MATRIX_B);
+        compositor.flush(lc);
+    }
     while (digitalRead(PIN_BUTTON) == LOW)
     {
         // Wacht tot de button wordt ingedrukt
@@ -458,44 +1260,141 @@ long getButtonDelay()
     return millis() - buttonDelay;
 }
 
+// Helderheid van het menu: op en neer tussen 0 en 9 in 600 miliseconden
+const static keyframe menuPulse[] PROGMEM = {{0, 0}, {300, 9}, {600, 0}};
+// Overgang naar een nieuw beeld: rij voor rij van boven naar beneden
+const static keyframe menuWipe[] PROGMEM = {{0, 0}, {MENU_WIPE, 8}};
+
+// Zet het overgangsbeeld in de overlay: de bovenste rows rijen komen uit to, de rest uit from
+void showWipe(const byte *from, const byte *to, byte rows)
+{
+    for (byte addr = 0; addr < 2; addr++)
+    {
+        for (byte row = 0; row < 8; row++)
+            compositor.setRow(addr, row, row < rows ? to[addr * 8 + row] : from[addr * 8 + row]);
+    }
+    compositor.flush(lc);
+}
+
+// Laat de animaties een frame verder lopen en stuur alleen wat veranderd is
+void animateMenu(const byte *from, const byte *to)
+{
+    byte changed = animation.update();
+
+    if (changed & (1 << ANIM_INTENSITY))
+        lc.setIntensityAll(animation.get(ANIM_INTENSITY));
+    if (changed & (1 << ANIM_WIPE))
+        showWipe(from, to, animation.get(ANIM_WIPE));
+}
+
+// Het menu ligt als overlay over het zand (BLEND_REPLACE): de simulatie zelf
+// wordt niet overschreven. Overgangen tussen het zand en de menu-items zijn
+// wipes, de helderheid pulseert. Beide lopen als sporen in animation.
 void setupZandloper()
 {
+    compositor.hide(lc);
+    // Bewaar het beeld en het schema, zodat de zandloper verder kan waar hij was
+    // als de mode niet verandert. Zolang het menu open is, staat de tijd stil.
+    lc.backup();
+    int previousMode = currentMode;
+    long untilDrop = neck.deadline() - millis();
+    if (untilDrop < 0)
+        untilDrop = 0;
+
     // We komen van een sensor LOW en wachten tot deze HIGH wordt. Dit voorkomt dat we direct weer terug gaan naar de setup als we al in de setup zitten.
     while (digitalRead(PIN_BUTTON) == LOW)
     {
         yield(); // Laat andere taken toe terwijl we wachten
     }
-    Serial.println("Setting up Zandloper");
+    LOG_INFO(LOG_SETUP);
+
+    // Van het zand naar de huidige mode
+    byte from[16], to[16];
+    for (byte i = 0; i < 8; i++)
+    {
+        from[i] = lc.getRow(MATRIX_A, i);
+        from[8 + i] = lc.getRow(MATRIX_B, i);
+    }
+    displayMode(currentMode, to);
+    showWipe(from, to, 0);
+    compositor.show(lc, BLEND_REPLACE);
+    animation.play(ANIM_INTENSITY, menuPulse, sizeof(menuPulse) / sizeof(keyframe), true);
+    animation.play(ANIM_WIPE, menuWipe, sizeof(menuWipe) / sizeof(keyframe), false);
 
     bool blnSetupMode = true;
+    byte count = modeCount();
 
     while (blnSetupMode)
     {
-        int milisPerMode = (millis() / 30) % 20;
-        if (milisPerMode >= 10)
-            milisPerMode = 19 - milisPerMode;
-
-        lc.setIntensity(0, milisPerMode);
-        lc.setIntensity(1, milisPerMode);
-
-        displayMode(currentMode);
+        animateMenu(from, to);
+        logger.drain();
+        protocol.service();
+        power.idle(MENU_FRAME);
+#if CAPTURE
+        ignoreButton();
+        capture.service();
+#endif
         long buttonDelay = getButtonDelay();
 
         if (buttonDelay > SETUPEXIT)
             blnSetupMode = false;
 
+        // Heel lang indrukken start de kalibratie van de accelerometer
+        if (buttonDelay > CALIBRATE_HOLD)
+            calibrateAccelerometer();
+
         // Check of de button delay binnen de marge van de button delay ligt. Zo ja, ga naar de volgende mode.
         if (buttonDelay >= BUTTONDELAY - BUTTONMARGIN && buttonDelay <= BUTTONDELAY + BUTTONMARGIN)
         {
             currentMode++;
-            if (currentMode >= sizeof(modes) / sizeof(modes[0]))
+            if (currentMode >= count)
                 currentMode = 0;
+            memcpy(from, to, sizeof(from));
+            displayMode(currentMode, to);
+            animation.play(ANIM_WIPE, menuWipe, sizeof(menuWipe) / sizeof(keyframe), false);
         }
     }
+    animation.stop(ANIM_INTENSITY);
+    lc.setIntensityAll(DISPLAY_INTENSITY);
+
+    // De instelling is nu gedaan. Zolang de overlay zichtbaar is, houdt LedControl
+    // de wijzigingen vast: het zand wordt eerst klaargezet en daarna in beeld geschoven.
+    if (currentMode == previousMode)
+    {
+        lc.restore();
+#if SAND_ENGINE == SAND_ENGINE_PARTICLES
+        particles.load(lc);
+#endif
+        neck.resume(untilDrop);
+    }
+    else
+    {
+        resetTime();
+        alarmWentOff = true;
+    }
 
-    // De instelling is nu gedaan
-    resetTime();
-    alarmWentOff = true;
+    // Na een kalibratie is de overlay al weg
+    if (compositor.visible())
+    {
+        memset(from, 0, sizeof(from));
+        for (byte i = 0; i < 8; i++)
+        {
+            to[i] = lc.getRow(MATRIX_A, i);
+            to[8 + i] = lc.getRow(MATRIX_B, i);
+        }
+        animation.play(ANIM_WIPE, menuWipe, sizeof(menuWipe) / sizeof(keyframe), false);
+        while (animation.playing(ANIM_WIPE))
+        {
+            animateMenu(from, to);
+            power.idle(MENU_FRAME);
+        }
+        animateMenu(from, to);
+    }
+    compositor.hide(lc);
+#if CAPTURE == CAPTURE_RING
+    // Wie het menu opent, heeft misschien net iets vreemds gezien: bewaar wat eraan voorafging
+    capture.action(CAPTURE_SAVE);
+#endif
 }
 
 /**
@@ -503,32 +1402,127 @@ void setupZandloper()
  */
 void loop()
 {
-    delay(DELAY_FRAME);
+    // Slaap tot de volgende korrel, of tot de volgende noot als die eerder is
+    unsigned long deadline = neck.deadline();
+    if (melody.playing() && (long)(melody.deadline() - deadline) < 0)
+        deadline = melody.deadline();
+    power.idle(frameRate.remaining(deadline));
+    frameRate.frame();
+    melody.service();
+#ifdef ZANDLOPER_PROFILE
+    unsigned long frameStart = micros();
+#endif
+
+    // Alles wat de interrupts sinds het vorige frame hebben verzameld in een keer
+    PROFILE_BEGIN(PROF_GRAVITY);
+    bool pressed = handleInput();
+    gravity = classifyGravity();
+    PROFILE_END(PROF_GRAVITY);
 
-    gravity = getGravity();
+    PROFILE_BEGIN(PROF_PROTOCOL);
+    handleCommands();
+    applyGravityOverride();
+    PROFILE_END(PROF_PROTOCOL);
 
     if (gravity != -1)
         lc.setRotation((ROTATION_OFFSET + gravity) % 360);
 
+    PROFILE_BEGIN(PROF_UPDATE);
     moved = updateMatrix();
-    dropped = dropParticle();
+    PROFILE_END(PROF_UPDATE);
+    PROFILE_BEGIN(PROF_DROP);
+    dropped = dropParticles();
+    PROFILE_END(PROF_DROP);
+    PROFILE_COUNT(drops, dropped);
+#if SAND_ENGINE == SAND_ENGINE_PARTICLES && defined(PARTICLE_REPORT)
+    reportParticles();
+#endif
+
+#if OVERLAY_TIME
+    if (gravity != -1 && gravity != overlayGravity)
+    {
+        if (overlayGravity != -1)
+            showRemainingTime();
+        overlayGravity = gravity;
+    }
+#endif
 
-    particlesTop = countParticles(getTopMatrix());
-    particlesBottom = countParticles(getBottomMatrix());
+    // Zolang er iets beweegt of net gedraaid is, draaien we op de hoge framerate
+    if (moved || dropped || gravity != lastGravity)
+        frameRate.activity();
+    lastGravity = gravity;
 
-    if (!moved && !dropped && !alarmWentOff && ((particlesTop == 60 && gravity == 0) || (particlesBottom == 60 && gravity == 180)))
+    PROFILE_BEGIN(PROF_COUNT);
+    int destination = neck.destination(gravity);
+    bool full = destination != -1 && countParticles(destination) == GRAINS;
+    PROFILE_END(PROF_COUNT);
+    if (!moved && !dropped && !alarmWentOff && full && sequencer.last())
     {
         alarmWentOff = true;
+        markDirty(true);
         alarm();
     }
+    if (neck.finished() && !moved && !dropped)
+        nextSegment();
 
     if (dropped)
     {
         alarmWentOff = false;
+        grainsTransferred += dropped;
+        markDirty(false);
     }
 
-    if (digitalRead(PIN_BUTTON) == LOW)
+    checkMemory();
+    checkDropped();
+    saveState();
+#if CAPTURE
+    unsigned long now = millis();
+    if (now - lastSnapshot >= CAPTURE_SNAPSHOT)
+        captureSnapshot(now, CAP_REASON_FIXED);
+    else if (capture.snapshotDue(now))
+        captureSnapshot(now, CAP_REASON_RING);
+    capture.service();
+#endif
+
+#if OVERLAY_TIME
+    if (compositor.visible())
+    {
+        if ((long)(millis() - overlayUntil) >= 0)
+            compositor.hide(lc);
+        else
+            compositor.flush(lc);
+    }
+#endif
+
+    // Het versturen kost per frame hooguit een FRAME_STATE en het legen van de zendbuffer
+    {
+        PROFILE_BEGIN(PROF_PROTOCOL);
+        if (streamPeriod > 0 && millis() - lastStream >= streamPeriod)
+        {
+            lastStream = millis();
+            sendState();
+        }
+        logger.drain();
+        protocol.service();
+        PROFILE_END(PROF_PROTOCOL);
+    }
+
+#ifdef ZANDLOPER_PROFILE
+    profile.frame(frameStart);
+#endif
+
+    if (pressed)
     {
         setupZandloper();
+        ignoreButton();
+        frameRate.activity();
     }
+
+    // Niet tijdens een lopend segment: millis() staat stil in power-down en een stap
+    // in het schema kan langer duren dan POWER_SHUTDOWN_AFTER
+    if (frameRate.idleTime() > POWER_SHUTDOWN_AFTER && neck.finished())
+        standby();
+
+    // De accelerometer meet op de achtergrond voor het volgende frame
+    input.sample();
 }
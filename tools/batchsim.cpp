@@ -0,0 +1,548 @@
+/*
+ * Batchsimulator voor de Margolus-zandmotor (SAND_ENGINE_MARGOLUS).
+ *
+ * Draait heel veel complete zandloperruns op de host: elke mode uit modes[],
+ * elk met een eigen seed en een willekeurig schema van omdraaiingen. Per run
+ * wordt bijgehouden wanneer het alarm afgaat ten opzichte van het schema van
+ * de hals, of er korrels verdwijnen of bijkomen, en hoeveel korrels er per
+ * frame bewegen.
+ *
+ * Bouwen (zonder -march=native valt de vectorcode terug op SSE2):
+ *   g++ -std=c++17 -O3 -march=native -pthread -DARDUINO=100 -I tools/host -I include \
+ *       tools/batchsim.cpp src/Margolus.cpp -o batchsim
+ *
+ * Gebruik:
+ *   ./batchsim [--runs N] [--mode I] [--threads T] [--flips K] [--frame MS] [--seed S] [--scaling]
+ *
+ *   --runs N     runs per mode (afgerond naar boven op een veelvoud van 256, standaard 4096)
+ *   --mode I     alleen modes[I], anders alle modes
+ *   --threads T  aantal threads, standaard alle cores
+ *   --flips K    maximaal aantal keren omdraaien per run, standaard 2
+ *   --frame MS   frametijd van de simulatie, standaard FRAME_FAST (25)
+ *   --seed S     startwaarde van de random generator
+ *   --scaling    meet runs per seconde voor 1, 2, 4 ... T threads
+ *
+ * Hoe het werkt: 256 borden liggen bit-gesliced naast elkaar. Cel (x,y) van
+ * alle borden is een vector van 256 bits (4 x 64, GCC vector extensions: AVX2
+ * met -mavx2, anders SSE2). Een Margolus-stap rekent elk blok voor alle
+ * borden tegelijk uit met en/of-logica uit margolusRules[] van src/Margolus.cpp,
+ * dus met dezelfde regels als de firmware. Alleen de random bits komen uit
+ * een eigen generator. Batches van 256 runs worden over de threads verdeeld
+ * via een gedeelde teller: een vrije thread pakt de volgende batch.
+ *
+ * De hals volgt Neck::owed() en de lus van dropParticles(): hooguit
+ * NECK_MAX_BURST korrels per frame, elke korrel schuift de deadline een stap
+ * op, en lukt een korrel niet, dan begint het schema opnieuw vanaf nu
+ * (Neck::skip()). Het verschuiven van de binnengekomen korrel met
+ * moveParticle() wordt niet nagebootst; de volgende Margolus-stap doet dat hier.
+ */
+#include <Arduino.h>
+#include "Margolus.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+unsigned long hostMillis = 0;
+
+// Gelijk aan src/main.cpp, include/Neck.h en include/FrameRate.h
+#define GRAINS 60
+static const int modes[] = {30, 60, 120, 300, 600};
+#define MODES (int)(sizeof(modes) / sizeof(modes[0]))
+#define FIRST_DROP 1000
+#define NECK_MAX_BURST 4
+#define FRAME_FAST 25
+
+#define LANES 256
+#define ERROR_BUCKETS 64
+#define MOVE_BUCKETS 129
+
+typedef uint64_t vec __attribute__((vector_size(32)));
+
+static inline bool lane(const vec &v, int k)
+{
+    return (v[k >> 6] >> (k & 63)) & 1;
+}
+
+static inline void setLane(vec &v, int k)
+{
+    v[k >> 6] |= 1ULL << (k & 63);
+}
+
+static uint64_t splitmix(uint64_t &s)
+{
+    uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+struct Stats {
+    uint64_t runs = 0;
+    uint64_t alarms = 0;
+    uint64_t timeouts = 0;
+    uint64_t conservation = 0;
+    uint64_t frames = 0;
+    int64_t errorSum = 0;
+    long errorMin = 0;
+    long errorMax = 0;
+    uint64_t errorHist[ERROR_BUCKETS] = {};
+    uint64_t moveHist[MOVE_BUCKETS] = {};
+
+    void merge(const Stats &o)
+    {
+        if (o.alarms && (!alarms || o.errorMin < errorMin))
+            errorMin = o.errorMin;
+        if (o.alarms && (!alarms || o.errorMax > errorMax))
+            errorMax = o.errorMax;
+        runs += o.runs;
+        alarms += o.alarms;
+        timeouts += o.timeouts;
+        conservation += o.conservation;
+        frames += o.frames;
+        errorSum += o.errorSum;
+        for (int i = 0; i < ERROR_BUCKETS; i++)
+            errorHist[i] += o.errorHist[i];
+        for (int i = 0; i < MOVE_BUCKETS; i++)
+            moveHist[i] += o.moveHist[i];
+    }
+};
+
+struct Options {
+    int runs = 4096;
+    int mode = -1;
+    int threads = 0;
+    int flips = 2;
+    int frame = FRAME_FAST;
+    uint64_t seed = 1;
+    bool scaling = false;
+};
+
+// Per uitgang van een blok: welke toestanden in tabel 0 en 1 die cel vullen
+static uint16_t ruleMask[2][4];
+
+static void buildRules()
+{
+    for (int t = 0; t < 2; t++)
+        for (int o = 0; o < 4; o++)
+        {
+            ruleMask[t][o] = 0;
+            for (int s = 0; s < 16; s++)
+                if ((pgm_read_byte_near(&margolusRules[t][s]) >> o) & 1)
+                    ruleMask[t][o] |= 1 << s;
+        }
+}
+
+class Batch {
+    vec upper[8][8]; // [y][x], logische coordinaten zoals Margolus::step
+    vec lower[8][8];
+    vec rng;
+    vec counter[8]; // bit-gesliced aantal veranderde cellen in dit frame
+    byte phase = 0;
+
+    unsigned long nextDrop[LANES];
+    unsigned long expected[LANES];
+    unsigned long flipAt[LANES][4];
+    byte flipCount[LANES];
+    byte flipIndex[LANES];
+    byte upperCount[LANES];
+    byte lowerCount[LANES];
+    bool alarmWentOff[LANES];
+    bool done[LANES];
+    int active;
+
+    vec random()
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return rng;
+    }
+
+    void count(vec changed)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            vec carry = counter[i] & changed;
+            counter[i] ^= changed;
+            changed = carry;
+        }
+    }
+
+    // Margolus::step() voor alle borden tegelijk, met dezelfde wand links en
+    // onder en lucht boven en rechts van het bord
+    void step(vec board[8][8])
+    {
+        static const vec wall = ~vec{};
+        static const vec air = {};
+        vec scratch[4];
+
+        for (int y = -phase; y < 7 + phase; y += 2)
+            for (int x = -phase; x < 7 + phase; x += 2)
+            {
+                vec *cell[4];
+                int cx[4] = {x + 1, x, x + 1, x};
+                int cy[4] = {y, y, y + 1, y + 1};
+                for (int i = 0; i < 4; i++)
+                {
+                    if (cx[i] >= 0 && cx[i] <= 7 && cy[i] >= 0 && cy[i] <= 7)
+                        cell[i] = &board[cy[i]][cx[i]];
+                    else
+                    {
+                        scratch[i] = (cx[i] < 0 || cy[i] > 7) ? wall : air;
+                        cell[i] = &scratch[i];
+                    }
+                }
+                vec b[4] = {*cell[0], *cell[1], *cell[2], *cell[3]};
+                vec pair[2][4];
+                for (int h = 0; h < 2; h++)
+                {
+                    vec lo = b[2 * h], hi = b[2 * h + 1];
+                    pair[h][0] = ~lo & ~hi;
+                    pair[h][1] = lo & ~hi;
+                    pair[h][2] = ~lo & hi;
+                    pair[h][3] = lo & hi;
+                }
+                vec coin = random();
+                vec out[4] = {};
+                for (int s = 0; s < 16; s++)
+                {
+                    vec term = pair[0][s & 3] & pair[1][s >> 2];
+                    for (int o = 0; o < 4; o++)
+                    {
+                        bool a = (ruleMask[0][o] >> s) & 1;
+                        bool c = (ruleMask[1][o] >> s) & 1;
+                        if (a && c)
+                            out[o] |= term;
+                        else if (a)
+                            out[o] |= term & ~coin;
+                        else if (c)
+                            out[o] |= term & coin;
+                    }
+                }
+                for (int i = 0; i < 4; i++)
+                {
+                    if (cell[i] == &scratch[i])
+                        continue;
+                    count(out[i] ^ b[i]);
+                    *cell[i] = out[i];
+                }
+            }
+    }
+
+    int popcount(vec board[8][8], int k)
+    {
+        int n = 0;
+        for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+                n += lane(board[y][x], k);
+        return n;
+    }
+
+    void checkConservation(Stats &stats)
+    {
+        for (int k = 0; k < LANES; k++)
+        {
+            if (done[k])
+                continue;
+            if (popcount(upper, k) != upperCount[k] || popcount(lower, k) != lowerCount[k])
+            {
+                stats.conservation++;
+                done[k] = true;
+                active--;
+            }
+        }
+    }
+
+    // Draai de borden waarvan het bit in mask staat 180 graden: boven en onder wisselen
+    void flip(const vec &mask)
+    {
+        vec u[8][8], l[8][8];
+
+        memcpy(u, upper, sizeof(u));
+        memcpy(l, lower, sizeof(l));
+        for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+            {
+                upper[y][x] = (mask & l[7 - y][7 - x]) | (~mask & u[y][x]);
+                lower[y][x] = (mask & u[7 - y][7 - x]) | (~mask & l[y][x]);
+            }
+    }
+
+  public:
+    void run(int mode, const Options &opt, uint64_t seed, Stats &stats)
+    {
+        unsigned long interval = (1000L * modes[mode]) / GRAINS;
+        unsigned long nominal = FIRST_DROP + (GRAINS - 1) * interval;
+        unsigned long limit = 3 * nominal + 10000;
+        uint64_t s = seed;
+
+        memset(upper, 0, sizeof(upper));
+        memset(lower, 0, sizeof(lower));
+        for (int i = 0; i < 4; i++)
+            rng[i] = splitmix(s) | 1;
+
+        // fill() uit src/main.cpp, in logische coordinaten
+        int n = 0;
+        for (int slice = 0; slice < 15; slice++)
+        {
+            int z = slice < 8 ? 0 : slice - 7;
+            for (int j = z; j <= slice - z; j++)
+                if (++n <= GRAINS)
+                    upper[7 - j][slice - j] = ~vec{};
+        }
+
+        for (int k = 0; k < LANES; k++)
+        {
+            nextDrop[k] = FIRST_DROP;
+            expected[k] = nominal;
+            upperCount[k] = GRAINS;
+            lowerCount[k] = 0;
+            alarmWentOff[k] = true;
+            done[k] = false;
+            flipIndex[k] = 0;
+            // Pas omdraaien na de eerste korrel: daarvoor is er nog geen alarm om op te wachten
+            flipCount[k] = opt.flips > 0 ? splitmix(s) % (opt.flips + 1) : 0;
+            for (int f = 0; f < flipCount[k]; f++)
+                flipAt[k][f] = FIRST_DROP + splitmix(s) % (nominal - FIRST_DROP);
+            std::sort(flipAt[k], flipAt[k] + flipCount[k]);
+        }
+
+        active = LANES;
+        phase = 0;
+        unsigned long now = 0;
+        for (unsigned long frame = 0; active > 0 && now < limit; frame++, now += opt.frame)
+        {
+            memset(counter, 0, sizeof(counter));
+            step(upper);
+            step(lower);
+            phase ^= 1;
+
+            // De hals, zoals dropParticles(): per bord hooguit owed korrels, elke
+            // korrel schuift de deadline een stap op. De eerste korrel die niet
+            // door kan, begint het schema opnieuw vanaf nu (Neck::skip()).
+            vec due = {};
+            byte owed[LANES];
+            byte dropped[LANES];
+            for (int k = 0; k < LANES; k++)
+            {
+                owed[k] = 0;
+                dropped[k] = 0;
+                if (done[k] || (long)(now - nextDrop[k]) < 0)
+                    continue;
+                unsigned long behind = (now - nextDrop[k]) / interval + 1;
+                owed[k] = behind > NECK_MAX_BURST ? NECK_MAX_BURST : behind;
+                setLane(due, k);
+            }
+            for (int i = 0; i < NECK_MAX_BURST; i++)
+            {
+                vec moved = due & upper[7][0] & ~lower[0][7];
+                vec next = {};
+                bool any = false;
+                upper[7][0] ^= moved;
+                lower[0][7] |= moved;
+                for (int k = 0; k < LANES; k++)
+                {
+                    if (!lane(due, k))
+                        continue;
+                    if (!lane(moved, k))
+                    {
+                        nextDrop[k] = now + interval;
+                        continue;
+                    }
+                    dropped[k]++;
+                    upperCount[k]--;
+                    lowerCount[k]++;
+                    alarmWentOff[k] = false;
+                    nextDrop[k] += interval;
+                    if (dropped[k] < owed[k])
+                    {
+                        setLane(next, k);
+                        any = true;
+                    }
+                }
+                if (!any)
+                    break;
+                due = next;
+            }
+
+            vec flips = {};
+            for (int k = 0; k < LANES; k++)
+            {
+                if (done[k])
+                    continue;
+                stats.frames++;
+                int changed = 0;
+                for (int i = 0; i < 8; i++)
+                    changed |= lane(counter[i], k) << i;
+                stats.moveHist[std::min(changed / 2, MOVE_BUCKETS - 1)]++;
+
+                if (!changed && !dropped[k] && !alarmWentOff[k] && lowerCount[k] == GRAINS)
+                {
+                    long error = (long)(now - expected[k]);
+                    int bucket = error <= 0 ? 0 : std::min((error + opt.frame - 1) / opt.frame, (long)ERROR_BUCKETS - 1);
+                    if (!stats.alarms || error < stats.errorMin)
+                        stats.errorMin = error;
+                    if (!stats.alarms || error > stats.errorMax)
+                        stats.errorMax = error;
+                    stats.alarms++;
+                    stats.errorSum += error;
+                    stats.errorHist[bucket]++;
+                    done[k] = true;
+                    active--;
+                    continue;
+                }
+
+                if (flipIndex[k] < flipCount[k] && now >= flipAt[k][flipIndex[k]])
+                {
+                    flipIndex[k]++;
+                    setLane(flips, k);
+                    std::swap(upperCount[k], lowerCount[k]);
+                    // Het schema loopt door: de nieuwe bovenkant is leeg na upperCount korrels
+                    expected[k] = std::max(nextDrop[k], now) + (upperCount[k] ? upperCount[k] - 1 : 0) * interval;
+                }
+            }
+            flip(flips);
+
+            if ((frame & 255) == 255)
+                checkConservation(stats);
+        }
+        checkConservation(stats);
+        for (int k = 0; k < LANES; k++)
+            if (!done[k])
+                stats.timeouts++;
+        stats.runs += LANES;
+    }
+};
+
+static double runAll(int mode, const Options &opt, int threads, Stats &total)
+{
+    int batches = (opt.runs + LANES - 1) / LANES;
+    std::atomic<int> next(0);
+    std::mutex lock;
+    std::vector<std::thread> pool;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < threads; t++)
+        pool.emplace_back([&]() {
+            Stats local;
+            Batch *batch = new Batch;
+            for (int b; (b = next++) < batches;)
+                batch->run(mode, opt, opt.seed * 0x100000001B3ULL ^ ((uint64_t)mode << 40) ^ b, local);
+            delete batch;
+            std::lock_guard<std::mutex> guard(lock);
+            total.merge(local);
+        });
+    for (auto &t : pool)
+        t.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(int mode, const Stats &s, double seconds, const Options &opt)
+{
+    printf("mode %d s: %llu runs in %.2f s (%.0f runs/s), %llu frames\n", modes[mode],
+           (unsigned long long)s.runs, seconds, s.runs / seconds, (unsigned long long)s.frames);
+    printf("  alarm: %llu, timeout: %llu, grains lost or gained: %llu\n", (unsigned long long)s.alarms,
+           (unsigned long long)s.timeouts, (unsigned long long)s.conservation);
+    if (s.alarms)
+        printf("  alarm error vs neck schedule: min %ld ms, avg %.1f ms, max %ld ms\n", s.errorMin,
+               (double)s.errorSum / s.alarms, s.errorMax);
+    for (int i = 0; i < ERROR_BUCKETS; i++)
+        if (s.errorHist[i])
+        {
+            if (i == 0)
+                printf("    <= 0 ms: %llu\n", (unsigned long long)s.errorHist[i]);
+            else
+                printf("    <= %d ms%s: %llu\n", i * opt.frame, i == ERROR_BUCKETS - 1 ? "+" : "",
+                       (unsigned long long)s.errorHist[i]);
+        }
+    // Grote aantallen komen alleen vlak na het omdraaien voor: die worden samengenomen
+    uint64_t moves = 0, tail = 0;
+    for (int i = 0; i < MOVE_BUCKETS; i++)
+    {
+        moves += i * s.moveHist[i];
+        if (i >= 8)
+            tail += s.moveHist[i];
+    }
+    printf("  grains moved per frame: avg %.3f\n", (double)moves / s.frames);
+    for (int i = 0; i < 8; i++)
+        if (s.moveHist[i])
+            printf("    %3d: %6.2f%%\n", i, 100.0 * s.moveHist[i] / s.frames);
+    if (tail)
+        printf("    >=8: %6.2f%%\n", 100.0 * tail / s.frames);
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool value = i + 1 < argc;
+        if (a == "--runs" && value)
+            opt.runs = atoi(argv[++i]);
+        else if (a == "--mode" && value)
+            opt.mode = atoi(argv[++i]);
+        else if (a == "--threads" && value)
+            opt.threads = atoi(argv[++i]);
+        else if (a == "--flips" && value)
+            opt.flips = std::min(atoi(argv[++i]), 4);
+        else if (a == "--frame" && value)
+            opt.frame = std::max(atoi(argv[++i]), 1);
+        else if (a == "--seed" && value)
+            opt.seed = strtoull(argv[++i], NULL, 0);
+        else if (a == "--scaling")
+            opt.scaling = true;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opt.threads <= 0)
+        opt.threads = std::max(1u, std::thread::hardware_concurrency());
+    if (opt.mode >= MODES)
+    {
+        fprintf(stderr, "mode must be 0..%d\n", MODES - 1);
+        return 1;
+    }
+    buildRules();
+
+    if (opt.scaling)
+    {
+        int mode = opt.mode >= 0 ? opt.mode : 0;
+        double base = 0;
+        printf("scaling, mode %d s, %d runs\n", modes[mode], opt.runs);
+        for (int t = 1;; t = std::min(t * 2, opt.threads))
+        {
+            Stats s;
+            double seconds = runAll(mode, opt, t, s);
+            double rate = s.runs / seconds;
+            if (t == 1)
+                base = rate;
+            printf("  %2d threads: %8.0f runs/s, efficiency %3.0f%%\n", t, rate, 100 * rate / (t * base));
+            if (t == opt.threads)
+                break;
+        }
+        return 0;
+    }
+
+    int failures = 0;
+    for (int mode = 0; mode < MODES; mode++)
+    {
+        if (opt.mode >= 0 && mode != opt.mode)
+            continue;
+        Stats s;
+        double seconds = runAll(mode, opt, opt.threads, s);
+        report(mode, s, seconds, opt);
+        failures += s.conservation;
+    }
+    // Een korrel die verdwijnt of bijkomt is altijd een fout in de regels
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Minimale Arduino-omgeving om modules uit src/ op de host te bouwen, voor de
+ * gereedschappen in tools/. PROGMEM is gewoon geheugen; de tijd komt van het
+ * programma zelf (hostMillis), zodat een simulatie sneller dan echt kan lopen.
+ */
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_byte_near(p) pgm_read_byte(p)
+#define memcpy_P memcpy
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#include <algorithm>
+using std::max;
+using std::min;
+#define constrain(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+/* Simulatietijd in miliseconden, door het hostprogramma bijgehouden */
+extern unsigned long hostMillis;
+
+inline unsigned long millis()
+{
+    return hostMillis;
+}
+
+inline unsigned long micros()
+{
+    return hostMillis * 1000;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+"""Zet de binaire log van de Zandloper (include/Log.h) om naar tekst.
+
+Gebruik:
+    python3 tools/logdecode.py /dev/ttyUSB0 [baud]
+    python3 tools/logdecode.py capture.bin
+
+Alleen logberichten en tekst worden getoond; andere frames worden overgeslagen.
+"""
+
+import sys
+
+from zandloper import BAUD, LogMessage, decode
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+    source = sys.argv[1]
+    if source.startswith("/dev/") or source.upper().startswith("COM"):
+        import serial  # pyserial
+
+        baud = int(sys.argv[2]) if len(sys.argv) > 2 else BAUD
+        read = serial.Serial(source, baud).read
+    else:
+        read = open(source, "rb").read
+    for item in decode(read):
+        if isinstance(item, (LogMessage, str)):
+            print(item, flush=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
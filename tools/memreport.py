@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Statisch SRAM- en flashgebruik per module van een PlatformIO-build.
+
+Gebruik:
+    python3 tools/memreport.py .pio/build/nanoatmega328 [--size-tool avr-size] [--ram-budget 1536]
+
+Voor elk objectbestand uit src/ en voor het Arduino-framework wordt getoond
+hoeveel flash (text + data) en statisch SRAM (data + bss) het kost. Komt het
+totale statische SRAM van firmware.elf boven het budget, dan stopt het script
+met een foutcode, zodat een nieuwe buffer of cache niet ongemerkt de stack
+opeet. Wordt na elke build aangeroepen vanuit tools/pio_memreport.py.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+# De ATmega328P heeft 2048 bytes SRAM. Houd er minstens 512 over voor de stack.
+DEFAULT_RAM_BUDGET = 1536
+
+
+def sizes(tool, path):
+    """Geef (naam, text, data, bss) voor elk object in path (ook in archieven)."""
+    out = subprocess.run([tool, "-B", path], capture_output=True, text=True, check=True).stdout
+    for line in out.splitlines()[1:]:
+        fields = line.split(None, 5)
+        if len(fields) < 6:
+            continue
+        name = fields[5].split(" (ex ")[0]
+        yield name, int(fields[0]), int(fields[1]), int(fields[2])
+
+
+def module_name(build_dir, path):
+    rel = os.path.relpath(path, build_dir)
+    if rel.startswith("src" + os.sep):
+        return os.path.basename(rel).split(".")[0]
+    if "FrameworkArduino" in rel:
+        return "(arduino core)"
+    return "(" + rel.split(os.sep)[0] + ")"
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("build_dir")
+    parser.add_argument("--size-tool", default="avr-size")
+    parser.add_argument("--ram-budget", type=int, default=DEFAULT_RAM_BUDGET)
+    args = parser.parse_args()
+
+    modules = {}
+    for root, _, files in os.walk(args.build_dir):
+        for f in files:
+            if not (f.endswith(".o") or f.endswith(".a")):
+                continue
+            # libFrameworkArduino.a bevat dezelfde objecten als FrameworkArduino/
+            if f.endswith(".a") and os.path.isdir(os.path.join(root, f[3 if f.startswith("lib") else 0:-2])):
+                continue
+            path = os.path.join(root, f)
+            key = module_name(args.build_dir, path)
+            total = modules.setdefault(key, [0, 0, 0])
+            for _, text, data, bss in sizes(args.size_tool, path):
+                total[0] += text
+                total[1] += data
+                total[2] += bss
+
+    print("%-20s %8s %8s" % ("module", "flash", "sram"))
+    for name, (text, data, bss) in sorted(modules.items(), key=lambda m: -(m[1][1] + m[1][2])):
+        print("%-20s %8d %8d" % (name, text + data, data + bss))
+
+    elf = os.path.join(args.build_dir, "firmware.elf")
+    if not os.path.exists(elf):
+        return 0
+    _, text, data, bss = next(sizes(args.size_tool, elf))
+    ram = data + bss
+    print("%-20s %8d %8d  (na linken, budget %d)" % ("firmware.elf", text + data, ram, args.ram_budget))
+    if ram > args.ram_budget:
+        print("Statisch SRAM %d bytes is meer dan het budget van %d bytes" % (ram, args.ram_budget),
+              file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
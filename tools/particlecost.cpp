@@ -0,0 +1,158 @@
+/*
+ * Rekentijd van de deeltjesmotor (SAND_ENGINE_PARTICLES) voor een aantal
+ * korrels, ook meer dan op de Nano past: op de host geldt de grens van 64
+ * korrels uit Particles.h niet, dus met -DPARTICLE_MAX=128 is een volle
+ * wereld (beide matrices) te meten.
+ *
+ * Per aantal korrels draait src/Particles.cpp een vast scenario: rechtop
+ * leeglopen met een korrel per 10 frames door de hals, schuin houden, en
+ * omdraaien. Gemeten wordt de tijd per Particles::step() op de host en het
+ * aantal korrels dat per stap van cel wisselt (PROFILE_COUNT grainsMoved).
+ *
+ * Een schatting voor de ATmega328 volgt uit de twee paden in step(): een
+ * korrel die vrij beweegt kost ongeveer PATH_FREE klokcycli, een korrel die
+ * vastligt probeert drie keer tryMove() met isFree() en kost ongeveer
+ * PATH_BLOCKED. De host meet alleen hoe de kosten schalen; de cycli op de
+ * Nano zelf geeft een build met -D PARTICLE_REPORT (LOG_PARTICLE_TIME).
+ *
+ * Bouwen, op de nagebootste kern van tools/replay:
+ *   g++ -std=c++17 -O2 -DARDUINO=100 -DZANDLOPER_PROFILE -DPARTICLE_MAX=128 -I tools/replay -I include \
+ *       tools/replay/core.cpp src/Input.cpp src/LedControl.cpp src/Particles.cpp src/Power.cpp src/Profile.cpp \
+ *       tools/particlecost.cpp -o particlecost
+ *
+ * Gebruik:
+ *   ./particlecost [--grains N] [--runs R]
+ *
+ *   --grains N  alleen N korrels (hooguit PARTICLE_MAX), anders 60 en PARTICLE_MAX
+ *   --runs R    aantal keren het scenario, standaard 200
+ */
+#include <Arduino.h>
+#include "LedControl.h"
+#include "Particles.h"
+#include "Profile.h"
+#include "host.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Geschatte klokcycli per korrel per stap op de ATmega328 (16-bit int, een
+// shift over een variabel aantal bits is een lus): snelheid bijwerken en
+// een geslaagde tryMove() met twee keer setOccupied(), tegenover drie
+// mislukte tryMove() met elk een isFree() en de randen uitrekenen
+#define PATH_FREE 300
+#define PATH_BLOCKED 550
+#define AVR_MHZ 16
+
+// Zwaartekracht in ADC-eenheden (70 is ongeveer 1g) in ruwe coordinaten:
+// matrix A ligt op (8..15, 8..15), dus rechtop met A boven is (-, -)
+struct phase {
+    int gx;
+    int gy;
+    int frames;
+};
+static const phase scenario[] = {
+    {-50, -50, 400}, // rechtop, A loopt leeg naar B
+    {-70, 0, 200},   // schuin
+    {50, 50, 400},   // omgedraaid
+};
+
+struct cost {
+    double hostNanos;
+    unsigned long steps;
+    unsigned long moved;
+};
+
+// Korrels van boven naar beneden in A, wat niet past in B
+static void fillGrains(LedControl &lc, int grains)
+{
+    for (int addr = 0; addr < 2; addr++)
+        lc.clearDisplay(addr);
+    for (int i = 0; i < grains && i < 128; i++)
+    {
+        int addr = i < 64 ? 0 : 1;
+        int cell = 63 - (i & 63);
+        lc.setRawXY(addr, cell & 7, cell >> 3, true);
+    }
+}
+
+static cost measure(LedControl &lc, int grains, int runs)
+{
+    cost c = {0, 0, 0};
+    Particles particles;
+
+    for (int run = 0; run < runs; run++)
+    {
+        fillGrains(lc, grains);
+        particles.load(lc);
+        for (const phase &p : scenario)
+        {
+            for (int frame = 0; frame < p.frames; frame++)
+            {
+                unsigned long before = profile.data.grainsMoved;
+                auto start = std::chrono::steady_clock::now();
+                particles.step(p.gx, p.gy, frame % 10 == 0 ? 1 : 0);
+                c.hostNanos += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                c.moved += profile.data.grainsMoved - before;
+                c.steps++;
+            }
+        }
+    }
+    return c;
+}
+
+static void report(int grains, const cost &c)
+{
+    double moved = (double)c.moved / c.steps;
+    double cycles = moved * PATH_FREE + (grains - moved) * PATH_BLOCKED;
+
+    printf("%3d korrels: %5.0f ns per stap op de host, %4.1f korrels wisselen van cel,\n", grains,
+           c.hostNanos / c.steps, moved);
+    printf("             geschat op de Nano %5.0f cycli gemiddeld, %5d als alles vastligt (%.2f ms bij %d MHz)\n",
+           cycles, grains * PATH_BLOCKED, grains * PATH_BLOCKED / (AVR_MHZ * 1000.0), AVR_MHZ);
+}
+
+int main(int argc, char **argv)
+{
+    int only = 0;
+    int runs = 200;
+
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--grains" && a + 1 < argc)
+            only = atoi(argv[++a]);
+        else if (arg == "--runs" && a + 1 < argc)
+            runs = atoi(argv[++a]);
+        else
+        {
+            fprintf(stderr, "gebruik: %s [--grains N] [--runs R]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (only > PARTICLE_MAX || runs < 1)
+    {
+        fprintf(stderr, "hooguit %d korrels (bouw met -DPARTICLE_MAX=128), en minstens 1 run\n", PARTICLE_MAX);
+        return 1;
+    }
+
+    // Alleen de opgeslagen toestand: niets naar de (nagebootste) matrices
+    LedControl lc(5, 4, 6, 2);
+    lc.hold(true);
+
+    if (only)
+        report(only, measure(lc, only, runs));
+    else
+    {
+        cost small = measure(lc, 60, runs);
+        report(60, small);
+        if (PARTICLE_MAX > 60)
+        {
+            cost large = measure(lc, PARTICLE_MAX, runs);
+            report(PARTICLE_MAX, large);
+            printf("%d tegen 60 korrels: %.2f keer zo veel tijd op de host\n", PARTICLE_MAX,
+                   (large.hostNanos / large.steps) / (small.hostNanos / small.steps));
+        }
+    }
+    return 0;
+}
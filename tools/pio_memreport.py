@@ -0,0 +1,7 @@
+# PlatformIO extra_script: toon na elke build het geheugengebruik per module
+Import("env")
+
+env.AddPostAction(
+    "$BUILD_DIR/${PROGNAME}.elf",
+    '"$PYTHONEXE" "$PROJECT_DIR/tools/memreport.py" "$BUILD_DIR" --size-tool "$SIZETOOL"',
+)
@@ -0,0 +1,205 @@
+/*
+ * Stresstest voor include/Queue.h op de host.
+ *
+ * Op de Nano is de schrijver een interrupt die loop() op elk moment kan
+ * onderbreken, maar nooit andersom. Dat wordt hier nagebootst met een
+ * signaal: een timer (setitimer) onderbreekt de lezer steeds op een
+ * willekeurige plek en de signal handler schrijft een paar elementen, net als
+ * een ISR. Daarnaast draait dezelfde test met een schrijver in een eigen
+ * thread, zodat ook de volgorde van geheugenoperaties op een multicore
+ * processor wordt getest.
+ *
+ * Elk element bevat een volgnummer en een controlewaarde. De lezer controleert
+ * dat niets dubbel, beschadigd of in de verkeerde volgorde aankomt, en dat elk
+ * ontbrekend volgnummer door de schrijver als verloren is geteld.
+ *
+ * Bouwen:
+ *   g++ -std=c++17 -O2 -pthread -DARDUINO=100 -I tools/host -I include \
+ *       tools/queuestress.cpp -o queuestress
+ *
+ * Gebruik:
+ *   ./queuestress [--seconds S]
+ *
+ * De exitcode is 0 als beide tests slagen en 2 bij een fout.
+ */
+#include <Arduino.h>
+#include "Queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <sys/time.h>
+#include <thread>
+
+unsigned long hostMillis = 0;
+
+struct item {
+    uint32_t sequence;
+    uint32_t check;
+};
+
+static uint32_t checksum(uint32_t sequence)
+{
+    return sequence * 2654435761u ^ 0xA5A5A5A5u;
+}
+
+// Klein genoeg om vaak vol te lopen
+typedef Queue<item, 8> testQueue;
+
+/* Houdt bij wat de lezer heeft gezien */
+struct reader {
+    uint32_t expected = 0;
+    unsigned long received = 0;
+    unsigned long skipped = 0;
+    unsigned long errors = 0;
+
+    void take(const item &i)
+    {
+        if (i.check != checksum(i.sequence) || i.sequence < expected)
+        {
+            errors++;
+            return;
+        }
+        skipped += i.sequence - expected;
+        expected = i.sequence + 1;
+        received++;
+    }
+};
+
+static bool report(const char *name, const reader &r, unsigned long pushed, unsigned long lost, byte dropped)
+{
+    // Wat na het laatst gelezen element verloren ging, is ook overgeslagen.
+    // Queue::dropped() telt in een byte, dus die vergelijken we modulo 256.
+    unsigned long skipped = r.skipped + (pushed - r.expected);
+    bool ok = r.errors == 0 && r.received + lost == pushed && skipped == lost && (byte)lost == dropped;
+
+    printf("%-8s %10lu geschreven %10lu gelezen %8lu verloren %6lu fouten  %s\n",
+           name, pushed, r.received, lost, r.errors, ok ? "ok" : "FOUT");
+    return ok;
+}
+
+// --------------------------------------------------
+// Schrijver als signal handler, zoals een ISR
+// --------------------------------------------------
+static testQueue signalQueue;
+static volatile uint32_t signalSequence = 0;
+static volatile unsigned long signalLost = 0;
+static volatile unsigned long signalCount = 0;
+
+static void producerInterrupt(int)
+{
+    // Een paar elementen per interrupt, net als de ADC die X en Y na elkaar meldt
+    byte burst = 1 + (signalCount++ % 3);
+
+    for (byte b = 0; b < burst; b++)
+    {
+        uint32_t s = signalSequence;
+        item i = {s, checksum(s)};
+
+        if (!signalQueue.push(i))
+            signalLost = signalLost + 1;
+        signalSequence = s + 1;
+    }
+}
+
+static bool testInterrupt(double seconds)
+{
+    reader r;
+    struct sigaction action = {};
+    action.sa_handler = producerInterrupt;
+    sigaction(SIGALRM, &action, NULL);
+
+    struct itimerval timer = {};
+    timer.it_interval.tv_usec = 17;
+    timer.it_value.tv_usec = 17;
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    unsigned long spin = 0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        item i;
+        // Niet te snel lezen, anders loopt de buffer nooit vol
+        if (++spin % 64 == 0)
+        {
+            while (signalQueue.pop(i))
+                r.take(i);
+        }
+    }
+
+    timer = {};
+    setitimer(ITIMER_REAL, &timer, NULL);
+    signal(SIGALRM, SIG_IGN);
+
+    item i;
+    while (signalQueue.pop(i))
+        r.take(i);
+    return report("signaal", r, signalSequence, signalLost, signalQueue.dropped());
+}
+
+// --------------------------------------------------
+// Schrijver in een eigen thread
+// --------------------------------------------------
+static bool testThread(double seconds)
+{
+    testQueue queue;
+    std::atomic<bool> running(true);
+    unsigned long pushed = 0;
+    unsigned long lost = 0;
+
+    std::thread producer([&]() {
+        uint32_t s = 0;
+        while (running.load(std::memory_order_relaxed))
+        {
+            item i = {s, checksum(s)};
+            if (!queue.push(i))
+            {
+                lost++;
+                // Met een core komt de lezer anders bijna nooit aan de beurt
+                std::this_thread::yield();
+            }
+            s++;
+        }
+        pushed = s;
+    });
+
+    reader r;
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        item i;
+        for (int n = 0; n < 1000; n++)
+            if (queue.pop(i))
+                r.take(i);
+    }
+    running = false;
+    producer.join();
+
+    item i;
+    while (queue.pop(i))
+        r.take(i);
+    return report("thread", r, pushed, lost, queue.dropped());
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 2;
+
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--seconds" && a + 1 < argc)
+            seconds = atof(argv[++a]);
+        else
+        {
+            fprintf(stderr, "gebruik: %s [--seconds S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bool ok = testInterrupt(seconds);
+    ok = testThread(seconds) && ok;
+    return ok ? 0 : 2;
+}
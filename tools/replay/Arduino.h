@@ -0,0 +1,117 @@
+/*
+ * Nagebootste Arduino-kern om de hele firmware op de host te draaien, voor
+ * tools/replay. Tijd, pinnen, ADC, seriele poort en EEPROM worden door
+ * core.cpp nagespeeld vanuit een opname (zie host.h).
+ *
+ * Let op: een int is hier 32 bits, op de ATmega 16.
+ */
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "binary.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+// Arduino Nano
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+
+// Zoals de macro's van de Arduino-kern: werkt ook met verschillende typen.
+// Het resultaat is een waarde (+ 0), geen referentie naar een parameter.
+template <typename A, typename B>
+inline auto min(A a, B b) -> decltype(a < b ? a + 0 : b + 0)
+{
+    return b < a ? b : a;
+}
+template <typename A, typename B>
+inline auto max(A a, B b) -> decltype(a < b ? a + 0 : b + 0)
+{
+    return a < b ? b : a;
+}
+#define constrain(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value);
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Zelfde generator als random() van avr-libc, zodat een zaad hetzelfde zand geeft
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Teksten met F() staan op de ATmega in flash, hier gewoon in het geheugen
+class __FlashStringHelper;
+#define F(text) ((const __FlashStringHelper *)(text))
+
+class HardwareSerial {
+  public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    int availableForWrite();
+    size_t write(uint8_t b);
+    void flush();
+
+    // Alleen tekst naar stdout, voor Profile::dump()
+    size_t print(const char *text);
+    size_t print(const __FlashStringHelper *text) { return print((const char *)text); }
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(int value) { return print((long)value); }
+    size_t print(unsigned int value) { return print((unsigned long)value); }
+    size_t println();
+    template <typename T>
+    size_t println(T value)
+    {
+        return print(value) + println();
+    }
+};
+
+extern HardwareSerial Serial;
+
+#endif
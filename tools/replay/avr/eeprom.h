@@ -0,0 +1,16 @@
+/* 1 KB EEPROM in het geheugen van de host, zie core.cpp */
+#ifndef avr_eeprom_h
+#define avr_eeprom_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+uint16_t eeprom_read_word(const uint16_t *address);
+void eeprom_read_block(void *destination, const void *source, size_t n);
+void eeprom_write_byte(uint8_t *address, uint8_t value);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_update_block(const void *source, void *destination, size_t n);
+bool eeprom_is_ready();
+
+#endif
@@ -0,0 +1,11 @@
+/* Interrupts zijn gewone functies die core.cpp aanroept */
+#ifndef avr_interrupt_h
+#define avr_interrupt_h
+
+#define ISR(vector) extern "C" void vector(void)
+#define EMPTY_INTERRUPT(vector) extern "C" void vector(void) {}
+
+void cli();
+void sei();
+
+#endif
@@ -0,0 +1,54 @@
+/* Registers van de ATmega328P die de firmware gebruikt, nagebootst door core.cpp */
+#ifndef avr_io_h
+#define avr_io_h
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+// ADCSRA
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+// ADMUX
+#define REFS0 6
+#define REFS1 7
+// WDTCSR en MCUSR
+#define WDP0 0
+#define WDP1 1
+#define WDP2 2
+#define WDE 3
+#define WDCE 4
+#define WDP3 5
+#define WDIE 6
+#define WDRF 3
+
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+/*
+ * ADCSRA is een object: schrijven met ADSC start een conversie, lezen laat de
+ * tijd een beetje lopen, zodat wachten op een conversie ook hier eindigt.
+ */
+class hostAdcControl {
+  public:
+    uint8_t value;
+
+    operator uint8_t();
+    hostAdcControl &operator=(int v);
+    hostAdcControl &operator|=(int v) { return *this = value | v; }
+    hostAdcControl &operator&=(int v) { return *this = value & v; }
+};
+
+extern hostAdcControl ADCSRA;
+extern volatile uint8_t ADMUX;
+extern volatile uint16_t ADC;
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t WDTCSR;
+
+#endif
@@ -0,0 +1,14 @@
+/* Slapen laat de nagebootste tijd lopen tot de volgende interrupt, zie core.cpp */
+#ifndef avr_sleep_h
+#define avr_sleep_h
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+
+void set_sleep_mode(int mode);
+void sleep_enable();
+void sleep_disable();
+void sleep_cpu();
+void sleep_mode();
+
+#endif
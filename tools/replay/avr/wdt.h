@@ -0,0 +1,8 @@
+/* De watchdog wekt alleen uit power-down; dat doet core.cpp zelf */
+#ifndef avr_wdt_h
+#define avr_wdt_h
+
+inline void wdt_reset() {}
+inline void wdt_disable() {}
+
+#endif
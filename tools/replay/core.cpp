@@ -0,0 +1,549 @@
+/*
+ * Nagebootste Arduino-kern voor tools/replay, zie host.h.
+ */
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <util/crc16.h>
+#include "Memory.h"
+#include "host.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+
+// Wat een handeling op een ATmega op 16 MHz ongeveer kost, in microseconden
+#define COST_CALL 2        // millis(), digitalRead(), een register lezen
+#define COST_PIN_WRITE 4   // digitalWrite()
+#define COST_SHIFT_OUT 85  // shiftOut() van een byte met digitalWrite()
+#define COST_ANALOG_READ 112
+#define ADC_CONVERSION 104 // een conversie met de klok op 125 kHz
+
+// Een opgenomen analogRead() mag zoveel later zijn geweest dan het naspelen hem vraagt
+#define READ_SLACK 50
+// Metingen van de interrupt die zoveel ouder zijn dan nu, zijn overgeslagen
+#define CONVERSION_SLACK 250
+
+#define PROTOCOL_SYNC 0x7E
+
+extern "C" void ADC_vect(void);
+extern "C" void WDT_vect(void);
+
+uint64_t hostMicros = 0;
+bool hostHold = false;
+uint64_t hostEnd = UINT64_MAX;
+hostCounters hostCount;
+void (*hostFrameHandler)(uint8_t type, const uint8_t *payload, uint8_t length) = NULL;
+
+hostAdcControl ADCSRA;
+volatile uint8_t ADMUX;
+volatile uint16_t ADC;
+volatile uint8_t MCUSR;
+volatile uint8_t WDTCSR;
+
+HardwareSerial Serial;
+
+static uint8_t buttonPin = 2;
+static uint8_t channelX = 1;
+static uint8_t channelY = 2;
+
+static std::deque<hostPair> conversions;
+static std::deque<hostPair> reads;
+static std::deque<hostEdge> edges;
+static std::deque<std::pair<unsigned long, uint8_t>> serialIn;
+static hostPair current = {0, 512, 512};
+static bool buttonDown = false;
+
+static bool interruptsOn = true;
+static bool inInterrupt = false;
+static void (*handlers[2])(void);
+static int handlerModes[2];
+static bool changePending[2];
+
+static bool adcBusy = false;
+static bool adcPending = false;
+static uint64_t adcDone;
+
+static int sleepMode = SLEEP_MODE_IDLE;
+static uint8_t eeprom[E2END + 1];
+static int32_t randomState = 1;
+
+// --------------------------------------------------
+// Invoer
+// --------------------------------------------------
+void hostConfigure(uint8_t button, uint8_t pinX, uint8_t pinY)
+{
+    buttonPin = button;
+    channelX = pinX - A0;
+    channelY = pinY - A0;
+    memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+void hostAddConversion(const hostPair &pair)
+{
+    conversions.push_back(pair);
+}
+
+void hostAddRead(const hostPair &pair)
+{
+    reads.push_back(pair);
+}
+
+void hostAddEdge(const hostEdge &edge)
+{
+    edges.push_back(edge);
+}
+
+void hostAddSerial(unsigned long time, const uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+        serialIn.push_back(std::make_pair(time, data[i]));
+}
+
+void hostStart(unsigned long start, bool down)
+{
+    hostMicros = (uint64_t)start * 1000;
+    buttonDown = down;
+    while (!edges.empty() && edges.front().time < start)
+        edges.pop_front();
+    while (!serialIn.empty() && serialIn.front().first < start)
+        serialIn.pop_front();
+    while (!reads.empty() && reads.front().time < start)
+        reads.pop_front();
+    while (!conversions.empty() && conversions.front().time < start)
+    {
+        current = conversions.front();
+        conversions.pop_front();
+    }
+}
+
+// --------------------------------------------------
+// Tijd en interrupts
+// --------------------------------------------------
+static unsigned long nowMillis()
+{
+    return hostMicros / 1000;
+}
+
+static void finishConversion()
+{
+    uint8_t channel = ADMUX & 0x07;
+
+    adcBusy = false;
+    if (channel == channelX)
+    {
+        while (conversions.size() > 1 && conversions.front().time + CONVERSION_SLACK < nowMillis())
+            conversions.pop_front();
+        if (!conversions.empty())
+        {
+            current = conversions.front();
+            conversions.pop_front();
+        }
+        ADC = current.x;
+        hostCount.conversions++;
+    }
+    else if (channel == channelY)
+        ADC = current.y;
+    else
+        ADC = 512;
+    ADCSRA.value = (ADCSRA.value & ~_BV(ADSC)) | _BV(ADIF);
+    adcPending = ADCSRA.value & _BV(ADIE);
+}
+
+// Voer uit wat er nu aan interrupts klaarstaat, zoals de ATmega dat na elke instructie doet
+static void deliver()
+{
+    while (!edges.empty() && (uint64_t)edges.front().time * 1000 <= hostMicros)
+    {
+        buttonDown = edges.front().down;
+        edges.pop_front();
+        changePending[digitalPinToInterrupt(buttonPin)] = true;
+    }
+    if (adcBusy && hostMicros >= adcDone)
+        finishConversion();
+
+    if (!interruptsOn || inInterrupt)
+        return;
+    inInterrupt = true;
+    for (int i = 0; i < 2; i++)
+    {
+        bool fire = false;
+        if (handlers[i] && handlerModes[i] == CHANGE && changePending[i])
+            fire = true;
+        if (handlers[i] && handlerModes[i] == LOW && buttonDown && digitalPinToInterrupt(buttonPin) == i)
+            fire = true;
+        changePending[i] = false;
+        if (fire)
+            handlers[i]();
+    }
+    if (adcPending)
+    {
+        adcPending = false;
+        ADCSRA.value &= ~_BV(ADIF);
+        ADC_vect();
+    }
+    inInterrupt = false;
+}
+
+// Laat de tijd lopen tot target en voer onderweg de interrupts uit
+static void advanceTo(uint64_t target)
+{
+    if (hostMicros >= hostEnd)
+        throw hostStop();
+    deliver();
+    if (hostHold)
+        return;
+    while (hostMicros < target)
+    {
+        uint64_t next = target;
+        if (!edges.empty())
+            next = std::min(next, std::max((uint64_t)edges.front().time * 1000, hostMicros + 1));
+        if (adcBusy)
+            next = std::min(next, std::max(adcDone, hostMicros + 1));
+        hostMicros = next;
+        deliver();
+    }
+}
+
+static void advance(unsigned long us)
+{
+    advanceTo(hostMicros + us);
+}
+
+unsigned long millis()
+{
+    advance(COST_CALL);
+    return nowMillis();
+}
+
+unsigned long micros()
+{
+    advance(COST_CALL);
+    return hostMicros;
+}
+
+void delay(unsigned long ms)
+{
+    advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    advance(us);
+}
+
+void yield()
+{
+    advance(COST_CALL);
+}
+
+void cli()
+{
+    interruptsOn = false;
+}
+
+void sei()
+{
+    interruptsOn = true;
+    deliver();
+}
+
+void set_sleep_mode(int mode)
+{
+    sleepMode = mode;
+}
+
+void sleep_enable() {}
+
+void sleep_disable() {}
+
+void sleep_cpu()
+{
+    if (sleepMode == SLEEP_MODE_PWR_DOWN)
+    {
+        // millis() staat stil in power-down; hier is het altijd de watchdog die wekt
+        hostCount.powerDowns++;
+        sei();
+        WDT_vect();
+        advance(COST_CALL);
+        return;
+    }
+    // Idle: Timer0 wekt elke miliseconde, of eerder een andere interrupt
+    uint64_t start = hostMicros;
+    uint64_t target = (hostMicros / 1000 + 1) * 1000;
+    if (!edges.empty())
+        target = std::min(target, std::max((uint64_t)edges.front().time * 1000, hostMicros + 1));
+    if (adcBusy)
+        target = std::min(target, adcDone);
+    advanceTo(target);
+    hostCount.sleptMicros += hostMicros - start;
+}
+
+void sleep_mode()
+{
+    sleep_cpu();
+}
+
+hostAdcControl::operator uint8_t()
+{
+    advance(COST_CALL);
+    return value;
+}
+
+hostAdcControl &hostAdcControl::operator=(int v)
+{
+    bool start = (v & _BV(ADSC)) && !adcBusy;
+
+    value = v;
+    if (start)
+    {
+        adcBusy = true;
+        adcDone = hostMicros + (hostHold ? 0 : ADC_CONVERSION);
+    }
+    return *this;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode)
+{
+    if (interrupt > 1)
+        return;
+    handlers[interrupt] = handler;
+    handlerModes[interrupt] = mode;
+    changePending[interrupt] = false;
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+    if (interrupt <= 1)
+        handlers[interrupt] = NULL;
+}
+
+// --------------------------------------------------
+// Pinnen
+// --------------------------------------------------
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+    advance(COST_PIN_WRITE);
+}
+
+int digitalRead(uint8_t pin)
+{
+    advance(COST_CALL);
+    if (pin == buttonPin)
+        return buttonDown ? LOW : HIGH;
+    return HIGH;
+}
+
+int analogRead(uint8_t pin)
+{
+    uint8_t channel = pin >= A0 ? pin - A0 : pin;
+
+    advance(COST_ANALOG_READ);
+    hostCount.reads++;
+    if (channel == channelX)
+    {
+        if (!reads.empty() && reads.front().time <= nowMillis() + READ_SLACK)
+        {
+            current = reads.front();
+            reads.pop_front();
+        }
+        return current.x;
+    }
+    if (channel == channelY)
+        return current.y;
+    return 512;
+}
+
+void shiftOut(uint8_t, uint8_t, uint8_t, uint8_t)
+{
+    hostCount.spiBytes++;
+    advance(COST_SHIFT_OUT);
+}
+
+void tone(uint8_t, unsigned int, unsigned long)
+{
+    hostCount.tones++;
+}
+
+void noTone(uint8_t) {}
+
+// --------------------------------------------------
+// random() van avr-libc (Park en Miller)
+// --------------------------------------------------
+static int32_t nextRandom()
+{
+    int32_t x = randomState;
+    if (x == 0)
+        x = 123459876L;
+    int32_t hi = x / 127773L;
+    int32_t lo = x % 127773L;
+    x = 16807L * lo - 2836L * hi;
+    if (x < 0)
+        x += 0x7FFFFFFFL;
+    randomState = x;
+    return x % ((uint32_t)0x7FFFFFFFL + 1);
+}
+
+long random(long howbig)
+{
+    if (howbig == 0)
+        return 0;
+    return nextRandom() % (int32_t)howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig)
+        return howsmall;
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+    if (seed != 0)
+        randomState = (int32_t)(uint32_t)seed;
+}
+
+// --------------------------------------------------
+// Seriele poort
+// --------------------------------------------------
+static uint8_t frameBuffer[3 + 255 + 1];
+static int framePos = 0;
+
+// Zoek de frames in wat de firmware verstuurt
+static void parseOutput(uint8_t b)
+{
+    if (framePos == 0 && b != PROTOCOL_SYNC)
+        return;
+    frameBuffer[framePos++] = b;
+    if (framePos >= 3 && framePos == 3 + frameBuffer[2] + 1)
+    {
+        uint8_t crc = 0;
+        for (int i = 1; i < framePos - 1; i++)
+            crc = _crc8_ccitt_update(crc, frameBuffer[i]);
+        if (crc == frameBuffer[framePos - 1] && hostFrameHandler)
+            hostFrameHandler(frameBuffer[1], &frameBuffer[3], frameBuffer[2]);
+        framePos = 0;
+    }
+}
+
+void HardwareSerial::begin(unsigned long) {}
+
+int HardwareSerial::available()
+{
+    int n = 0;
+    for (size_t i = 0; i < serialIn.size() && serialIn[i].first <= nowMillis(); i++)
+        n++;
+    return n;
+}
+
+int HardwareSerial::read()
+{
+    if (available() == 0)
+        return -1;
+    uint8_t b = serialIn.front().second;
+    serialIn.pop_front();
+    return b;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    return 63;
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+    hostCount.serialBytes++;
+    parseOutput(b);
+    return 1;
+}
+
+void HardwareSerial::flush() {}
+
+size_t HardwareSerial::print(const char *text)
+{
+    return fputs(text, stdout) >= 0 ? strlen(text) : 0;
+}
+
+size_t HardwareSerial::print(long value)
+{
+    return printf("%ld", value);
+}
+
+size_t HardwareSerial::print(unsigned long value)
+{
+    return printf("%lu", value);
+}
+
+size_t HardwareSerial::println()
+{
+    return printf("\n");
+}
+
+// --------------------------------------------------
+// EEPROM
+// --------------------------------------------------
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    return eeprom[(uintptr_t)address & E2END];
+}
+
+uint16_t eeprom_read_word(const uint16_t *address)
+{
+    uintptr_t a = (uintptr_t)address & E2END;
+    return eeprom[a] | (eeprom[(a + 1) & E2END] << 8);
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        ((uint8_t *)destination)[i] = eeprom_read_byte((const uint8_t *)source + i);
+}
+
+void eeprom_write_byte(uint8_t *address, uint8_t value)
+{
+    eeprom[(uintptr_t)address & E2END] = value;
+    hostCount.eepromWrites++;
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+    if (eeprom_read_byte(address) != value)
+        eeprom_write_byte(address, value);
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        eeprom_update_byte((uint8_t *)destination + i, ((const uint8_t *)source)[i]);
+}
+
+bool eeprom_is_ready()
+{
+    return true;
+}
+
+// --------------------------------------------------
+// Memory.h: op de host is er geen stack om te meten
+// --------------------------------------------------
+int memoryFree()
+{
+    return RAMEND;
+}
+
+int memoryHeadroom()
+{
+    return RAMEND;
+}
+
+int memoryStackUsed()
+{
+    return 0;
+}
+
+bool memoryGuardBreached()
+{
+    return false;
+}
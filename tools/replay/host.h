@@ -0,0 +1,79 @@
+/*
+ * De nagebootste Arduino-kern van core.cpp, zoals replay.cpp hem voedt.
+ *
+ * Alle tijd is nagebootst: hostMicros loopt alleen als de firmware iets doet
+ * dat op de ATmega tijd kost (een pin lezen of schrijven, shiftOut, een
+ * conversie, slapen). Slapen springt naar de volgende interrupt: een tik van
+ * Timer0, een flank van de knop of het einde van een ADC-conversie.
+ *
+ * Metingen van de ADC-interrupt worden op volgorde gebruikt, zodat elk frame
+ * dezelfde meting krijgt als op de zandloper; analogRead() neemt de volgende
+ * opgenomen meting zodra die er op de nagebootste tijd bijna is. De knop en
+ * de commando's volgen de tijd van de opname.
+ */
+#ifndef host_h
+#define host_h
+
+#include <stdint.h>
+#include <vector>
+
+/* Een meting van X en Y op tijd (millis) */
+struct hostPair {
+    unsigned long time;
+    int x;
+    int y;
+};
+
+/* Een flank van de knop op tijd (millis) */
+struct hostEdge {
+    unsigned long time;
+    bool down;
+};
+
+/* Wat de firmware tot nu toe heeft gedaan, om per frame te tellen */
+struct hostCounters {
+    unsigned long spiBytes;      // met shiftOut naar de matrices
+    unsigned long serialBytes;   // naar de seriele poort
+    unsigned long conversions;   // ADC-conversies van de interrupt
+    unsigned long reads;         // analogRead()
+    unsigned long tones;         // tone()
+    unsigned long eepromWrites;  // bytes die echt veranderden
+    unsigned long powerDowns;    // keren in power-down
+    uint64_t sleptMicros;        // in idle geslapen
+};
+
+extern uint64_t hostMicros;
+extern hostCounters hostCount;
+
+/*
+ * Zolang hostHold aan staat, staat de klok stil en is een conversie meteen
+ * klaar; wacht de firmware dan op de tijd, dan blijft hij hangen
+ */
+extern bool hostHold;
+
+/* Zodra hostMicros hier voorbij is, gooit de kern hostStop, waar de firmware ook is */
+extern uint64_t hostEnd;
+struct hostStop {
+};
+
+/* Pinnen van de knop en de accelerometer, zoals in src/main.cpp */
+void hostConfigure(uint8_t buttonPin, uint8_t pinX, uint8_t pinY);
+
+void hostAddConversion(const hostPair &pair);
+void hostAddRead(const hostPair &pair);
+void hostAddEdge(const hostEdge &edge);
+
+/* Bytes die op tijd (millis) op de seriele poort binnenkomen */
+void hostAddSerial(unsigned long time, const uint8_t *data, uint8_t length);
+
+/*
+ * Zet de klok op start (millis) en gooi alle invoer van daarvoor weg.
+ * Params :
+ * buttonDown	de knop was toen ingedrukt
+ */
+void hostStart(unsigned long start, bool buttonDown);
+
+/* Wordt aangeroepen voor elk frame dat de firmware over de seriele poort stuurt */
+extern void (*hostFrameHandler)(uint8_t type, const uint8_t *payload, uint8_t length);
+
+#endif
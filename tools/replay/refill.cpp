@@ -0,0 +1,178 @@
+/*
+ * Controle op de host voor een programma met CUE_REFILL: na elk segment moet
+ * al het zand terug in de matrix waar de hals uit stroomt, in elke richting
+ * waarin de hals werkt. Draait de echte firmware uit src/ op de nagebootste
+ * kern van tools/replay (core.cpp, host.h), zonder opname: de accelerometer
+ * staat stil in een richting en het programma wordt met CMD_MODE gekozen.
+ *
+ * Per richting, elk in een eigen proces zodat setup() met een leeg EEPROM
+ * begint, wordt gecontroleerd dat na elke refill alle korrels aan de kant
+ * van de bron liggen en dat er in elk segment zand door de hals gaat.
+ * Zijwaarts eindigt een segment nooit (de hals ligt op halve hoogte), daar
+ * is alleen te zien hoeveel korrels erdoor gaan.
+ *
+ * Bouwen, zoals replay:
+ *   g++ -std=c++17 -O2 -DARDUINO=100 -DCAPTURE=1 -I tools/replay -I include \
+ *       tools/replay/core.cpp tools/replay/refill.cpp $(ls src/[A-Za-z]*.cpp | grep -v Memory) -o refill
+ *
+ * Gebruik:
+ *   ./refill [--mode N]
+ *
+ *   --mode N    het programma (index zoals CMD_MODE), standaard het eerste met CUE_REFILL
+ *
+ * De exitcode is 0 als alle richtingen kloppen en 2 als er een afwijkt.
+ */
+#include <Arduino.h>
+#include "Neck.h"
+#include "Protocol.h"
+#include "Sequencer.h"
+#include "host.h"
+#include <util/crc16.h>
+
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Gelijk aan src/main.cpp
+#define PIN_X A1
+#define PIN_Y A2
+#define PIN_BUTTON 2
+
+// Uit src/main.cpp
+void setup();
+void loop();
+int countParticles(int addr);
+extern int gravity;
+extern Neck neck;
+extern Sequencer sequencer;
+extern byte grainsTransferred;
+
+// Ruwe ADC-waarden die met de standaardkalibratie de vier richtingen geven
+static const int tilts[4][2] = {{315, 385}, {385, 315}, {315, 245}, {245, 315}};
+
+// Het eerste ingebouwde programma met een refill (P4)
+#define REFILL_MODE 8
+// Ruim genoeg voor de drie segmenten van 40 seconden van P4
+#define RUN_MILLIS 200000UL
+
+static void addCommand(unsigned long time, byte type, const byte *payload, byte length)
+{
+    byte frame[PROTOCOL_MAX_PAYLOAD + 4];
+    byte crc = _crc8_ccitt_update(0, type);
+
+    crc = _crc8_ccitt_update(crc, length);
+    frame[0] = PROTOCOL_SYNC;
+    frame[1] = type;
+    frame[2] = length;
+    for (byte i = 0; i < length; i++)
+    {
+        frame[3 + i] = payload[i];
+        crc = _crc8_ccitt_update(crc, payload[i]);
+    }
+    frame[3 + length] = crc;
+    hostAddSerial(time, frame, length + 4);
+}
+
+/*
+ * Draai het programma met de zandloper stil in een richting.
+ * Returns : true als elke refill het zand aan de bron legt en elk segment zand laat lopen
+ */
+static bool run(int tilt, byte mode)
+{
+    byte command = mode;
+    int segment = -1;
+    int segments = 0;
+    bool ok = true;
+
+    for (unsigned long t = 0; t < RUN_MILLIS; t++)
+    {
+        hostAddConversion({t, tilts[tilt][0], tilts[tilt][1]});
+        hostAddRead({t, tilts[tilt][0], tilts[tilt][1]});
+    }
+    addCommand(1000, CMD_MODE, &command, 1);
+    hostStart(0, false);
+    hostEnd = (uint64_t)RUN_MILLIS * 1000;
+
+    try
+    {
+        setup();
+        for (;;)
+        {
+            byte before = grainsTransferred;
+            int index = sequencer.index();
+
+            loop();
+            if (hostMicros < 1500000ULL || sequencer.index() == index)
+                continue;
+            int destination = neck.destination(gravity);
+            int source = neck.source(gravity);
+            if (destination == -1)
+            {
+                printf("richting %d: de hals werkt niet\n", gravity);
+                return true;
+            }
+            int atSource = countParticles(source);
+            printf("richting %d, segment %d: %d korrels door de hals, na de refill %d van %d aan de bron\n",
+                   gravity, index, before, atSource, countParticles(source) + countParticles(destination));
+            // Het eerste segment na CMD_MODE telt nog niet mee: het begon halverwege de opstart
+            if (segment >= 0 && before == 0)
+                ok = false;
+            if (atSource != countParticles(source) + countParticles(destination))
+                ok = false;
+            segment = index;
+            segments++;
+        }
+    }
+    catch (const hostStop &)
+    {
+    }
+    if (segments == 0)
+    {
+        printf("richting %d: het programma komt niet voorbij segment %d, %d korrels door de hals\n", gravity,
+               sequencer.index(), grainsTransferred);
+        // Zijwaarts ligt de hals op halve hoogte: het zand eronder loopt nooit leeg, dus
+        // het segment eindigt niet en er komt geen refill om te controleren
+        return gravity == 90 || gravity == 270;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    byte mode = REFILL_MODE;
+    bool ok = true;
+
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--mode" && a + 1 < argc)
+            mode = atoi(argv[++a]);
+        else
+        {
+            fprintf(stderr, "gebruik: %s [--mode N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (int tilt = 0; tilt < 4; tilt++)
+    {
+        int status;
+        pid_t child;
+
+        fflush(stdout);
+        child = fork();
+
+        if (child == 0)
+        {
+            hostConfigure(PIN_BUTTON, PIN_X, PIN_Y);
+            bool same = run(tilt, mode);
+            fflush(stdout);
+            _exit(same ? 0 : 2);
+        }
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+    }
+    printf("%s\n", ok ? "refill klopt" : "refill wijkt af");
+    return ok ? 0 : 2;
+}
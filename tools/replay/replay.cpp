@@ -0,0 +1,514 @@
+/*
+ * Speelt een invoeropname van de zandloper (include/Capture.h) na met de echte
+ * firmware: setup(), loop(), getGravity(), het setupmenu en de zandmotor uit
+ * src/ draaien op een nagebootste Arduino-kern (core.cpp, host.h).
+ *
+ * Het naspelen begint bij de eerste volledige momentopname in de opname: die
+ * toestand gaat als persistRecord in het nagebootste EEPROM, zodat setup()
+ * hem hervat, en de random generators krijgen het opgenomen zaad. Zolang
+ * setup() loopt, staat de nagebootste klok stil. Daarna
+ * krijgt de firmware dezelfde metingen, knopflanken en commando's als op de
+ * zandloper. De nagespeelde firmware neemt zelf ook momentopnamen; die worden
+ * een voor een vergeleken met de opgenomen: beeld, toestand, zaad en reden.
+ * Een opname uit de ring nam ook een momentopname als de ring half vol was;
+ * die vraagt replay op dezelfde tijd aan de nagespeelde firmware. De vaste
+ * momentopnamen, de frametijd en de richting lopen door vanaf de begintoestand;
+ * een melodie die toen speelde niet, en met SAND_ENGINE_PARTICLES ook niet de
+ * snelheid van de korrels: begint het naspelen terwijl het zand stroomt, dan
+ * kan die motor een paar pixels afwijken. De opgenomen kalibratie wordt
+ * daarbij overgenomen, omdat de Calibrator zelf meer metingen doet dan er in
+ * de opname staan.
+ *
+ * Per frame (een aanroep van loop()) wordt de kost bijgehouden: bytes naar de
+ * matrices, de geschatte wakkere tijd op de ATmega volgens het kostenmodel
+ * van core.cpp en de echte tijd op de host.
+ *
+ * Bouwen, met dezelfde -D-vlaggen als de firmware van de opname, maar altijd
+ * met -DCAPTURE=1:
+ *   g++ -std=c++17 -O2 -DARDUINO=100 -DCAPTURE=1 -I tools/replay -I include \
+ *       tools/replay/core.cpp tools/replay/replay.cpp $(ls src/[A-Za-z]*.cpp | grep -v Memory) -o replay
+ *
+ * Gebruik:
+ *   ./replay opname.bin [--frames] [--log] [--until MS]
+ *
+ *   opname.bin  blokken zoals tools/zandloper.py ze opslaat: lengte en dan het blok
+ *   --frames    een regel per frame: tijd, zwaartekracht, bytes, wakker, host
+ *   --log       de logberichten van de firmware (id en argumenten)
+ *   --until MS  stop bij deze millis() in plaats van na de laatste invoer
+ *
+ * De exitcode is 0 als alle momentopnamen overeenkomen, 2 als er een afwijkt.
+ * Memory.cpp blijft buiten de build: het meet de stack met symbolen van de
+ * AVR-linker; core.cpp geeft vaste waarden.
+ */
+#include <Arduino.h>
+#include "Capture.h"
+#include "FrameRate.h"
+#include "LedControl.h"
+#include "Log.h"
+#include "Melody.h"
+#include "Persist.h"
+#include "host.h"
+#include <util/crc16.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// De nagespeelde firmware stuurt zijn eigen momentopnamen over de seriele poort
+#if CAPTURE != CAPTURE_SERIAL
+#error "bouw met -DCAPTURE=1, ook voor een opname uit de ring"
+#endif
+
+// Gelijk aan src/main.cpp
+#define PIN_X A1
+#define PIN_Y A2
+#define PIN_BUTTON 2
+
+// Uit src/main.cpp
+void setup();
+void loop();
+void reseed(unsigned int seed);
+extern LedControl lc;
+extern Persist persist;
+extern calibration cal;
+extern int gravity;
+extern int lastGravity;
+extern int overlayGravity;
+extern int currentMode;
+extern byte grainsTransferred;
+extern unsigned long lastSnapshot;
+extern FrameRate frameRate;
+extern Melody melody;
+
+struct snapshot {
+    unsigned long time;
+    byte state[7];
+    calibration cal;
+    byte board[16];
+    unsigned int seed;
+    byte reason;
+    // Miliseconden voor time: de vorige vaste momentopname, de laatste activiteit, het begin van het frame
+    unsigned int fixed;
+    unsigned int active;
+    unsigned int frame;
+    int gravity;
+};
+
+/* Leest blokken; met input gaan de records als invoer naar de kern */
+struct decoder {
+    explicit decoder(bool fromInput) : input(fromInput) {}
+
+    bool input;
+    int x = 512, y = 512;
+    int previous = -1;
+    snapshot partial = {};
+    byte have = 0;
+    unsigned long last = 0;
+    unsigned long gaps = 0;
+    unsigned long lost = 0;
+    std::vector<snapshot> snapshots;
+    // Een commando in delen (CAPTURE_MORE) tot het laatste deel er is
+    byte command[PROTOCOL_MAX_PAYLOAD] = {};
+    int commandLength = 0;
+};
+
+struct frameCost {
+    unsigned long count;
+    unsigned long spiBytes;
+    unsigned long spiMax;
+    uint64_t awake;
+    uint64_t awakeMax;
+    double host;
+    double hostMax;
+};
+
+static decoder recorded(true);
+static decoder replayed(false);
+static bool printLog = false;
+static unsigned long menus = 0;
+
+static unsigned int le16(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static int sign4(int v)
+{
+    return v >= 8 ? v - 16 : v;
+}
+
+// Een commando gaat als protocolframe de nagebootste seriele poort in
+static void addCommand(unsigned long time, byte type, const byte *payload, byte length)
+{
+    byte frame[PROTOCOL_MAX_PAYLOAD + 4];
+    byte crc = _crc8_ccitt_update(0, type);
+
+    crc = _crc8_ccitt_update(crc, length);
+    frame[0] = PROTOCOL_SYNC;
+    frame[1] = type;
+    frame[2] = length;
+    for (byte i = 0; i < length; i++)
+    {
+        frame[3 + i] = payload[i];
+        crc = _crc8_ccitt_update(crc, payload[i]);
+    }
+    frame[3 + length] = crc;
+    hostAddSerial(time, frame, length + 4);
+}
+
+static void info(decoder &d, byte kind, const byte *data, unsigned long time)
+{
+    switch (kind)
+    {
+    case CAP_INFO_STATE:
+        memcpy(d.partial.state, data, sizeof(d.partial.state));
+        break;
+    case CAP_INFO_CAL:
+    {
+        int *values = &d.partial.cal.zero[0];
+        for (byte i = 0; i < sizeof(calibration) / sizeof(int); i++)
+            values[i] = (int16_t)le16(&data[2 * i]);
+        break;
+    }
+    case CAP_INFO_BOARD:
+        memcpy(d.partial.board, data, 16);
+        break;
+    case CAP_INFO_SEED:
+        d.partial.seed = le16(data);
+        d.partial.reason = data[2];
+        d.partial.fixed = le16(&data[3]);
+        d.partial.active = le16(&data[5]);
+        d.partial.frame = le16(&data[7]);
+        d.partial.gravity = (int16_t)le16(&data[9]);
+        d.partial.time = time;
+        if (d.have == 0x07)
+            d.snapshots.push_back(d.partial);
+        d.have = 0;
+        return;
+    case CAP_INFO_LOST:
+        d.lost += le16(data);
+        // Het verloren record kan een deel van een commando zijn
+        d.commandLength = 0;
+        return;
+    }
+    d.have |= 1 << kind;
+}
+
+/*
+ * Lees een blok. Returns : false als het blok niet klopt
+ */
+static bool decode(decoder &d, const byte *c, byte length)
+{
+    static const byte infoSizes[] = {7, sizeof(calibration) / sizeof(int) * 2, 16, 11, 2};
+    unsigned long time;
+    byte pos = CAPTURE_HEADER;
+
+    if (length < CAPTURE_HEADER)
+        return false;
+    if (d.previous >= 0 && c[0] != (byte)(d.previous + 1))
+    {
+        d.gaps++;
+        // Een momentopname of commando over een gat heen is niet compleet
+        d.have = 0;
+        d.commandLength = 0;
+    }
+    d.previous = c[0];
+    time = (unsigned long)c[1] | ((unsigned long)c[2] << 8) | ((unsigned long)c[3] << 16) | ((unsigned long)c[4] << 24);
+    while (pos < length)
+    {
+        byte tag = c[pos++];
+        byte type = tag >> 5;
+        unsigned int dt = tag & 0x1F;
+
+        if (dt == CAPTURE_DT_ESCAPE)
+        {
+            if (pos + 2 > length)
+                return false;
+            dt = le16(&c[pos]);
+            pos += 2;
+        }
+        time += dt;
+        switch (type)
+        {
+        case CAP_SAMPLE:
+        case CAP_READ:
+            if (pos + 3 > length)
+                return false;
+            d.x = c[pos] | ((c[pos + 2] & 0x03) << 8);
+            d.y = c[pos + 1] | (((c[pos + 2] >> 2) & 0x03) << 8);
+            pos += 3;
+            if (d.input && type == CAP_READ)
+                hostAddRead({time, d.x, d.y});
+            else if (d.input)
+                hostAddConversion({time, d.x, d.y});
+            break;
+        case CAP_DELTA:
+            if (pos + 1 > length)
+                return false;
+            d.x += sign4(c[pos] >> 4);
+            d.y += sign4(c[pos] & 0x0F);
+            pos++;
+            if (d.input)
+                hostAddConversion({time, d.x, d.y});
+            break;
+        case CAP_SAME:
+            if (d.input)
+                hostAddConversion({time, d.x, d.y});
+            break;
+        case CAP_BUTTON_DOWN:
+        case CAP_BUTTON_UP:
+            if (d.input)
+                hostAddEdge({time, type == CAP_BUTTON_DOWN});
+            break;
+        case CAP_COMMAND:
+        {
+            if (pos + 2 > length)
+                return false;
+            byte part = c[pos + 1] & ~CAPTURE_MORE;
+            if (pos + 2 + part > length)
+                return false;
+            // -1: de delen zijn samen langer dan een payload, het commando klopt niet
+            if (d.commandLength >= 0 && d.commandLength + part <= PROTOCOL_MAX_PAYLOAD)
+            {
+                memcpy(&d.command[d.commandLength], &c[pos + 2], part);
+                d.commandLength += part;
+            }
+            else
+                d.commandLength = -1;
+            if (!(c[pos + 1] & CAPTURE_MORE))
+            {
+                if (d.input && d.commandLength >= 0)
+                    addCommand(time, c[pos], d.command, d.commandLength);
+                d.commandLength = 0;
+            }
+            pos += 2 + part;
+            break;
+        }
+        case CAP_INFO:
+            if (pos + 1 > length || c[pos] >= sizeof(infoSizes) || pos + 1 + infoSizes[c[pos]] > length)
+                return false;
+            info(d, c[pos], &c[pos + 1], time);
+            pos += 1 + infoSizes[c[pos]];
+            break;
+        }
+    }
+    d.last = std::max(d.last, time);
+    return true;
+}
+
+static bool load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    int length;
+
+    if (!f)
+        return false;
+    while ((length = fgetc(f)) != EOF)
+    {
+        byte c[256];
+        if (length == 0 || fread(c, 1, length, f) != (size_t)length)
+            continue;
+        if (!decode(recorded, c, length))
+            fprintf(stderr, "blok %d klopt niet\n", c[0]);
+    }
+    fclose(f);
+    return true;
+}
+
+static void frameOut(byte type, const byte *payload, byte length)
+{
+    // De eigen opname van de nagespeelde firmware, voor de momentopnamen
+    if (type == FRAME_CAPTURE && length > 0)
+        decode(replayed, payload, length);
+    if (type != FRAME_LOG || length < 3)
+        return;
+    if (payload[0] == LOG_SETUP)
+        menus++;
+    if (!printLog)
+        return;
+    printf("%10llu log %d", (unsigned long long)(hostMicros / 1000), payload[0]);
+    for (byte i = 3; i + 1 < length; i += 2)
+        printf(" %d", (int16_t)le16(&payload[i]));
+    printf("\n");
+}
+
+// Zet een momentopname klaar in het EEPROM, zodat setup() hem hervat
+static void restore(const snapshot &s)
+{
+    persistRecord r;
+
+    memset(&r, 0, sizeof(r));
+    r.mode = s.state[0];
+    r.transferred = s.state[1];
+    r.flags = s.state[2];
+    r.nextDrop = le16(&s.state[3]);
+    r.segment = s.state[5];
+    r.grain = s.state[6];
+    memcpy(&r.cal, &s.cal, sizeof(calibration));
+    memcpy(r.boards, s.board, sizeof(r.boards));
+    persist.checkpoint(r);
+    while (persist.busy())
+        persist.service();
+}
+
+/*
+ * Vergelijk een momentopname van de nagespeelde firmware met de opgenomen.
+ * Returns : true als ze overeenkomen
+ */
+static bool compare(const snapshot &got, const snapshot &want)
+{
+    int pixels = 0;
+
+    for (byte i = 0; i < 16; i++)
+        pixels += __builtin_popcount(got.board[i] ^ want.board[i]);
+    bool same = pixels == 0 && memcmp(got.state, want.state, sizeof(got.state)) == 0 && got.seed == want.seed &&
+                got.reason == want.reason && got.time == want.time;
+    printf("momentopname %lu%s: %s", want.time, want.reason == CAP_REASON_RING ? " (ring)" : "",
+           same ? "gelijk" : "wijkt af");
+    if (!same)
+        printf(" (%d pixels, mode %d/%d, korrels %d/%d, zaad %u/%u, reden %d/%d, nagespeeld op %lu)", pixels,
+               got.state[0], want.state[0], got.state[1], want.state[1], got.seed, want.seed, got.reason,
+               want.reason, got.time);
+    if (memcmp(&cal, &want.cal, sizeof(calibration)) != 0)
+    {
+        memcpy(&cal, &want.cal, sizeof(calibration));
+        printf(", kalibratie overgenomen");
+    }
+    printf("\n");
+    return same;
+}
+
+static void add(frameCost &cost, unsigned long spi, uint64_t awake, double host)
+{
+    cost.count++;
+    cost.spiBytes += spi;
+    cost.spiMax = std::max(cost.spiMax, spi);
+    cost.awake += awake;
+    cost.awakeMax = std::max(cost.awakeMax, awake);
+    cost.host += host;
+    cost.hostMax = std::max(cost.hostMax, host);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    bool frames = false;
+    unsigned long until = 0;
+
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--frames")
+            frames = true;
+        else if (arg == "--log")
+            printLog = true;
+        else if (arg == "--until" && a + 1 < argc)
+            until = strtoul(argv[++a], NULL, 10);
+        else if (arg[0] != '-' && !path)
+            path = argv[a];
+        else
+            path = NULL, a = argc;
+    }
+    if (!path)
+    {
+        fprintf(stderr, "gebruik: %s opname.bin [--frames] [--log] [--until MS]\n", argv[0]);
+        return 1;
+    }
+
+    hostConfigure(PIN_BUTTON, PIN_X, PIN_Y);
+    if (!load(path))
+    {
+        fprintf(stderr, "kan %s niet lezen\n", path);
+        return 1;
+    }
+    if (recorded.snapshots.empty())
+    {
+        fprintf(stderr, "geen volledige momentopname in de opname, er is geen begintoestand\n");
+        return 1;
+    }
+
+    const snapshot &start = recorded.snapshots[0];
+    hostStart(start.time, false);
+    hostFrameHandler = frameOut;
+    hostEnd = (uint64_t)(until ? until : recorded.last + 2000) * 1000;
+    printf("opname: %lu .. %lu ms, %zu momentopnamen, %lu gaten, %lu records verloren\n", start.time,
+           recorded.last, recorded.snapshots.size(), recorded.gaps, recorded.lost);
+
+    frameCost cost = {};
+    size_t compared = 0;
+    size_t ring = 1;
+    bool same = true;
+    int previousGravity = gravity;
+    unsigned long gravityChanges = 0;
+
+    try
+    {
+        // De opname nam de momentopname aan het einde van setup() of van loop(): laat
+        // setup() geen tijd kosten, zodat het eerste frame op hetzelfde moment begint
+        hostHold = true;
+        restore(start);
+        setup();
+        reseed(start.seed);
+        lastSnapshot = start.time - start.fixed;
+        frameRate.resume(start.time - start.frame, start.time - start.active);
+        gravity = lastGravity = start.gravity;
+        overlayGravity = start.gravity;
+        // Midden in de opname was de melodie van setup() allang afgelopen
+        if (start.reason != CAP_REASON_BOOT)
+            melody.play(NULL, 0);
+        hostHold = false;
+        if (frames)
+            printf("frame tijd_ms zwaartekracht spi_bytes wakker_us host_us\n");
+        for (;;)
+        {
+            hostCounters before = hostCount;
+            uint64_t t0 = hostMicros;
+            auto h0 = std::chrono::steady_clock::now();
+
+            // De momentopnamen van de ring een voor een, zodra de vorige is genomen
+            while (ring < recorded.snapshots.size() && recorded.snapshots[ring].reason != CAP_REASON_RING)
+                ring++;
+            if (ring < recorded.snapshots.size() && capture.request(recorded.snapshots[ring].time))
+                ring++;
+
+            loop();
+
+            double host = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - h0).count();
+            unsigned long spi = hostCount.spiBytes - before.spiBytes;
+            uint64_t awake = (hostMicros - t0) - (hostCount.sleptMicros - before.sleptMicros);
+            add(cost, spi, awake, host);
+            if (frames)
+                printf("%lu %llu %d %lu %llu %.1f\n", cost.count, (unsigned long long)(t0 / 1000), gravity, spi,
+                       (unsigned long long)awake, host);
+            if (gravity != previousGravity)
+            {
+                gravityChanges++;
+                previousGravity = gravity;
+            }
+            // De eerste nagespeelde momentopname is die van setup(), net als de eerste opgenomen
+            while (compared + 1 < replayed.snapshots.size() && compared + 1 < recorded.snapshots.size())
+            {
+                compared++;
+                same = compare(replayed.snapshots[compared], recorded.snapshots[compared]) && same;
+            }
+        }
+    }
+    catch (const hostStop &)
+    {
+    }
+
+    if (cost.count == 0)
+        return 1;
+    printf("frames: %lu in %.1f s, zwaartekracht %lu keer veranderd, setupmenu %lu keer\n", cost.count,
+           (hostMicros / 1000 - start.time) / 1000.0, gravityChanges, menus);
+    printf("spi:    gemiddeld %.1f bytes per frame, hoogstens %lu\n", (double)cost.spiBytes / cost.count, cost.spiMax);
+    printf("wakker: gemiddeld %.0f us per frame, hoogstens %llu (geschat voor de ATmega)\n",
+           (double)cost.awake / cost.count, (unsigned long long)cost.awakeMax);
+    printf("host:   gemiddeld %.1f us per frame, hoogstens %.1f\n", cost.host / cost.count, cost.hostMax);
+    printf("invoer: %lu conversies, %lu keer analogRead(), %lu keer power-down\n", hostCount.conversions,
+           hostCount.reads, hostCount.powerDowns);
+    printf("momentopnamen: %zu van %zu vergeleken\n", compared, recorded.snapshots.size() - 1);
+    return same ? 0 : 2;
+}
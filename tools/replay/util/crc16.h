@@ -0,0 +1,23 @@
+/* Gelijk aan _crc8_ccitt_update en _crc16_update van avr-libc */
+#ifndef util_crc16_h
+#define util_crc16_h
+
+#include <stdint.h>
+
+inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    return crc;
+}
+
+inline uint16_t _crc16_update(uint16_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+        crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    return crc;
+}
+
+#endif
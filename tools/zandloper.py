@@ -0,0 +1,293 @@
+#!/usr/bin/env python3
+"""Host-kant van het seriele protocol van de Zandloper (include/Protocol.h).
+
+Als bibliotheek:
+
+    from zandloper import Client
+    z = Client("/dev/ttyUSB0")
+    z.stream(100)            # elke 100 ms een FRAME_STATE
+    for item in z.items():
+        print(item)
+
+Als programma toont het de stroom frames en logberichten:
+
+    python3 tools/zandloper.py /dev/ttyUSB0 [stream-ms]
+
+Een invoeropname (include/Capture.h) opslaan voor tools/replay:
+
+    python3 tools/zandloper.py /dev/ttyUSB0 capture opname.bin          # CAPTURE=1, tot Ctrl-C
+    python3 tools/zandloper.py /dev/ttyUSB0 capture opname.bin ring     # CAPTURE=2, de ring
+    python3 tools/zandloper.py /dev/ttyUSB0 capture opname.bin saved    # de ring uit EEPROM
+
+Een eigen programma (include/Sequencer.h), bijvoorbeeld 3 keer 20 seconden
+met daarna omdraaien:
+
+    z.program(3, [(20, 60, FLOW_EVEN | CUE_FLIP)])
+
+Het bestand bevat de blokken zoals ze binnenkomen, elk met een byte lengte ervoor.
+"""
+
+import struct
+import sys
+
+BAUD = 115200
+SYNC = 0x7E
+MAX_PAYLOAD = 24
+
+FRAME_LOG = 0x01
+FRAME_STATE = 0x02
+FRAME_MEMORY = 0x03
+FRAME_CAPTURE = 0x04
+CMD_STREAM = 0x10
+CMD_MODE = 0x11
+CMD_GRAVITY = 0x12
+CMD_RESET = 0x13
+CMD_PROFILE = 0x14
+CMD_MEMORY = 0x15
+CMD_CALIBRATE = 0x16
+CMD_CAPTURE = 0x17
+CMD_PROGRAM = 0x18
+
+# Acties van CMD_CAPTURE
+CAPTURE_DUMP = 0
+CAPTURE_SAVE = 1
+CAPTURE_DUMP_SAVED = 2
+
+# Vorm en cue van een segment van een programma
+FLOW_EVEN = 0x00
+FLOW_FAST_START = 0x01
+FLOW_SLOW_START = 0x02
+CUE_NONE = 0x00
+CUE_FLIP = 0x10
+CUE_REFILL = 0x20
+MAX_SEGMENTS = 5
+
+GRAVITY_AUTO = -2
+CYCLES_PER_US = 16
+
+# Houd deze lijst gelijk met enum logMessage in include/Log.h
+MESSAGES = [
+    ("Starting Zandloper", 0),
+    ("Starting sound!", 0),
+    ("Current mode: {0} s, first particle after {1} ms", 2),
+    ("Alarm!", 0),
+    ("Setting up Zandloper", 0),
+    ("Standby, awake {0}%", 1),
+    ("xCalc: {0} | yCalc: {1}", 2),
+    ("Particle step: {0} cycles, peak {1} cycles", 2),
+    ("Log overflow: {0} bytes dropped", 1),
+    ("Memory low: {0} bytes left between stack and heap", 1),
+    ("Resumed saved run: segment of {0} s, {1} grains already through", 2),
+    ("Calibrating accelerometer", 0),
+    ("Calibration: hourglass moved at {0} degrees (spread {1})", 2),
+    ("Calibration failed, keeping previous values", 0),
+    ("Calibrated: zero X {0}, zero Y {1}", 2),
+    ("First frame after {0}.{1:03d} ms", 2),
+    ("Capture saved: {0} bytes, {1} records lost", 2),
+    ("Segment {0}: {1} s", 2),
+    ("Queue overflow: {0} input events, {1} frames lost in total", 2),
+]
+
+# Argumenten die in microseconden binnenkomen maar als klokcycli worden getoond
+CYCLES = {7}
+
+
+def crc8(data):
+    """CRC-8 met polynoom 0x07, gelijk aan _crc8_ccitt_update van avr-libc."""
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def encode(frame_type, payload=b""):
+    body = bytes([frame_type, len(payload)]) + bytes(payload)
+    return bytes([SYNC]) + body + bytes([crc8(body)])
+
+
+class LogMessage:
+    def __init__(self, payload):
+        self.id = payload[0]
+        self.time = struct.unpack_from("<H", payload, 1)[0]
+        count = (len(payload) - 3) // 2
+        unsigned = self.id in CYCLES
+        self.args = list(struct.unpack_from("<" + ("H" if unsigned else "h") * count, payload, 3))
+        if unsigned:
+            self.args = [a * CYCLES_PER_US for a in self.args]
+
+    def __str__(self):
+        if self.id >= len(MESSAGES):
+            text = "unknown message %d %s" % (self.id, self.args)
+        else:
+            text = MESSAGES[self.id][0].format(*self.args)
+        # De tijd is millis() modulo 65536
+        return "%5d.%03d %s" % (self.time // 1000, self.time % 1000, text)
+
+
+class Memory:
+    def __init__(self, payload):
+        self.free, self.headroom, self.stack_used = struct.unpack_from("<hhh", payload)
+
+    def __str__(self):
+        return "free %d bytes, headroom %d bytes, stack used %d bytes" % (
+            self.free, self.headroom, self.stack_used)
+
+
+class State:
+    def __init__(self, payload):
+        self.rows_a = list(payload[0:8])
+        self.rows_b = list(payload[8:16])
+        self.count_a, self.count_b = payload[16], payload[17]
+        self.gravity = struct.unpack_from("<h", payload, 18)[0]
+        self.mode = payload[20]
+
+    def board(self):
+        """Beide matrices naast elkaar, B links en A rechts, in ruwe coordinaten."""
+        lines = []
+        for b, a in zip(self.rows_b, self.rows_a):
+            lines.append(format(b, "08b").replace("0", ".").replace("1", "#") + "  " +
+                         format(a, "08b").replace("0", ".").replace("1", "#"))
+        return "\n".join(lines)
+
+    def __str__(self):
+        return "mode %d gravity %d A=%d B=%d" % (self.mode, self.gravity, self.count_a, self.count_b)
+
+
+def decode(read):
+    """Lees bytes met read(n). Geeft LogMessage, State, (type, payload) of tekstregels."""
+    text = bytearray()
+    while True:
+        b = read(1)
+        if not b:
+            return
+        if b[0] != SYNC:
+            # Tekst buiten de frames, zoals de dump van de meetpunten
+            if b == b"\n":
+                yield text.decode("ascii", "replace")
+                text.clear()
+            elif b != b"\r":
+                text += b
+            continue
+        head = read(2)
+        if len(head) < 2 or head[1] > MAX_PAYLOAD:
+            continue
+        payload = read(head[1])
+        crc = read(1)
+        if len(payload) < head[1] or not crc or crc8(head + payload) != crc[0]:
+            continue
+        if head[0] == FRAME_LOG:
+            yield LogMessage(payload)
+        elif head[0] == FRAME_STATE:
+            yield State(payload)
+        elif head[0] == FRAME_MEMORY:
+            yield Memory(payload)
+        else:
+            yield (head[0], payload)
+
+
+class Client:
+    def __init__(self, port, baud=BAUD):
+        import serial  # pyserial
+
+        self.port = serial.Serial(port, baud)
+
+    def send(self, frame_type, payload=b""):
+        self.port.write(encode(frame_type, payload))
+
+    def stream(self, period_ms):
+        self.send(CMD_STREAM, struct.pack("<H", period_ms))
+
+    def set_mode(self, index):
+        self.send(CMD_MODE, bytes([index]))
+
+    def set_gravity(self, gravity):
+        self.send(CMD_GRAVITY, struct.pack("<h", gravity))
+
+    def reset(self):
+        self.send(CMD_RESET)
+
+    def profile(self):
+        self.send(CMD_PROFILE)
+
+    def memory(self):
+        self.send(CMD_MEMORY)
+
+    def calibrate(self):
+        """Start de kalibratie, of bevestig de volgende stand als die al loopt."""
+        self.send(CMD_CALIBRATE)
+
+    def capture(self, action):
+        """Vraag de opgenomen blokken op (CAPTURE_DUMP of CAPTURE_DUMP_SAVED) en geef ze terug."""
+        self.send(CMD_CAPTURE, bytes([action]))
+        chunks = []
+        for item in self.items():
+            if isinstance(item, tuple) and item[0] == FRAME_CAPTURE:
+                # Een leeg frame sluit de dump af
+                if not item[1]:
+                    break
+                chunks.append(item[1])
+        return chunks
+
+    def save_capture(self):
+        """Laat de zandloper de ring in EEPROM bewaren (CAPTURE=2)."""
+        self.send(CMD_CAPTURE, bytes([CAPTURE_SAVE]))
+
+    def program(self, repeat, segments):
+        """Zet een programma in EEPROM en begin ermee: segments is een lijst (seconden, korrels, vorm | cue)."""
+        if not 1 <= len(segments) <= MAX_SEGMENTS:
+            raise ValueError("1 tot %d segmenten" % MAX_SEGMENTS)
+        payload = struct.pack("<BB", repeat, len(segments))
+        for seconds, grains, shape in segments:
+            payload += struct.pack("<HBB", seconds, grains, shape)
+        self.send(CMD_PROGRAM, payload)
+
+    def items(self):
+        return decode(self.port.read)
+
+
+def write_chunk(out, chunk):
+    out.write(bytes([len(chunk)]) + bytes(chunk))
+
+
+def capture(client, path, source):
+    with open(path, "wb") as out:
+        if source in ("ring", "saved"):
+            chunks = client.capture(CAPTURE_DUMP if source == "ring" else CAPTURE_DUMP_SAVED)
+            for chunk in chunks:
+                write_chunk(out, chunk)
+            print("%d blokken" % len(chunks))
+            return 0
+        count = 0
+        try:
+            for item in client.items():
+                if isinstance(item, tuple) and item[0] == FRAME_CAPTURE and item[1]:
+                    write_chunk(out, item[1])
+                    count += 1
+                else:
+                    print(item)
+        except KeyboardInterrupt:
+            pass
+        print("%d blokken" % count)
+    return 0
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+    client = Client(sys.argv[1])
+    if len(sys.argv) > 3 and sys.argv[2] == "capture":
+        return capture(client, sys.argv[3], sys.argv[4] if len(sys.argv) > 4 else "serial")
+    if len(sys.argv) > 2:
+        client.stream(int(sys.argv[2]))
+    for item in client.items():
+        print(item)
+        if isinstance(item, State):
+            print(item.board())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())